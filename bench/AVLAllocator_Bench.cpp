@@ -0,0 +1,548 @@
+#include "../include/AVLAllocator.hpp"
+#include "../include/AVLTree.hpp"
+#include "../include/AugmentedSegmentManager.hpp"
+#include "../include/BPlusTree.hpp"
+#include "../include/SegmentManager.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Allocator microbenchmarks. Every scenario runs against AVLAllocator with and without the
+// thread cache, with the TLSF manager and with buddy blocks, std::allocator and malloc; the
+// structure scenarios compare the segment managers (best fit unless labelled otherwise), and
+// AVLTree and BPlusTree against std::multiset. Every operation is timed on its own, so the
+// latencies include one clock read (tens of nanoseconds) and the throughput is lower than
+// untimed code.
+// Prints one CSV line per run:
+//     scenario,backend,threads,ops,ops_per_sec,p50_ns,p99_ns,p999_ns
+// Usage: avlallocator-bench [scenario...]
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+using Yaro::Utility::AugmentedSegmentManager;
+using Yaro::Utility::AVLAllocator;
+using Yaro::Utility::AVLTree;
+using Yaro::Utility::BPlusTree;
+using Yaro::Utility::BTreeSegmentManager;
+using Yaro::Utility::SegmentManager;
+
+constexpr size_t Ops = 1000000u;
+constexpr size_t LiveSlots = 1024u;
+constexpr size_t NumBlocks = 8u;
+constexpr size_t BlockSize = size_t{256} << 20;
+
+uint64_t nextRandom(uint64_t &state)
+{
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return state >> 17;
+}
+
+template <typename T>
+struct MallocAllocator
+{
+    using value_type = T;
+
+    MallocAllocator() = default;
+
+    template <typename U>
+    MallocAllocator(const MallocAllocator<U> &)
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+        if (void *ptr = std::malloc(sizeof(T) * n))
+        {
+            return static_cast<T *>(ptr);
+        }
+        throw std::bad_alloc();
+    }
+
+    void deallocate(T *ptr, size_t)
+    {
+        std::free(ptr);
+    }
+
+    template <typename U>
+    bool operator==(const MallocAllocator<U> &) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const MallocAllocator<U> &) const
+    {
+        return false;
+    }
+};
+
+struct MallocBackend
+{
+    static constexpr const char *Name = "malloc";
+
+    template <typename T>
+    using Allocator = MallocAllocator<T>;
+};
+
+struct StdBackend
+{
+    static constexpr const char *Name = "std";
+
+    template <typename T>
+    using Allocator = std::allocator<T>;
+};
+
+struct AVLBackend
+{
+    static constexpr const char *Name = "avl";
+
+    template <typename T>
+    using Allocator = AVLAllocator<T, NumBlocks, BlockSize>;
+};
+
+struct TLSFAVLBackend
+{
+    static constexpr const char *Name = "avl-tlsf";
+
+    template <typename T>
+    using Allocator = AVLAllocator<T, NumBlocks, BlockSize, Yaro::Utility::TLSFAllocatorTraits>;
+};
+
+struct BuddyAVLBackend
+{
+    static constexpr const char *Name = "avl-buddy";
+
+    template <typename T>
+    using Allocator = AVLAllocator<T, NumBlocks, BlockSize, Yaro::Utility::BuddyAllocatorTraits>;
+};
+
+struct CachedAVLBackend
+{
+    static constexpr const char *Name = "avl-cached";
+
+    template <typename T>
+    using Allocator = AVLAllocator<T, NumBlocks, BlockSize, Yaro::Utility::ThreadCachedAllocatorTraits>;
+};
+
+// Per-operation latencies of one thread, in nanoseconds.
+class Samples
+{
+  public:
+    explicit Samples(size_t capacity)
+    {
+        m_values.reserve(capacity);
+    }
+
+    template <typename Operation>
+    void time(Operation &&operation)
+    {
+        const auto begin = Clock::now();
+        operation();
+        m_values.push_back(static_cast<uint32_t>(
+            std::min<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count(), UINT32_MAX)));
+    }
+
+    void merge(const Samples &other)
+    {
+        m_values.insert(m_values.end(), other.m_values.begin(), other.m_values.end());
+    }
+
+    size_t size() const
+    {
+        return m_values.size();
+    }
+
+    uint32_t percentile(double fraction)
+    {
+        if (m_values.empty())
+        {
+            return 0u;
+        }
+
+        const size_t index = std::min(m_values.size() - 1u, static_cast<size_t>(fraction * m_values.size()));
+        std::nth_element(m_values.begin(), m_values.begin() + index, m_values.end());
+        return m_values[index];
+    }
+
+  private:
+    std::vector<uint32_t> m_values;
+};
+
+void report(const char *scenario, const char *backend, size_t threads, Samples &samples, double seconds)
+{
+    std::printf("%s,%s,%zu,%zu,%.0f,%u,%u,%u\n", scenario, backend, threads, samples.size(),
+                static_cast<double>(samples.size()) / seconds, samples.percentile(0.5), samples.percentile(0.99),
+                samples.percentile(0.999));
+}
+
+// Frees and refills random slots of a fixed live set. `sizeOf` picks the size of each new allocation.
+template <typename Backend, typename SizeOf>
+void churn(Samples &samples, uint64_t seed, size_t ops, SizeOf &&sizeOf)
+{
+    typename Backend::template Allocator<char> alloc;
+
+    char *ptrs[LiveSlots] = {};
+    size_t sizes[LiveSlots] = {};
+
+    for (size_t i = 0u; i < ops; ++i)
+    {
+        const size_t slot = nextRandom(seed) % LiveSlots;
+
+        if (ptrs[slot] != nullptr)
+        {
+            samples.time([&] { alloc.deallocate(ptrs[slot], sizes[slot]); });
+            ptrs[slot] = nullptr;
+        }
+        else
+        {
+            sizes[slot] = sizeOf(seed);
+            samples.time([&] { ptrs[slot] = alloc.allocate(sizes[slot]); });
+            ptrs[slot][0] = 1;
+        }
+    }
+
+    for (size_t slot = 0u; slot < LiveSlots; ++slot)
+    {
+        if (ptrs[slot] != nullptr)
+        {
+            alloc.deallocate(ptrs[slot], sizes[slot]);
+        }
+    }
+}
+
+size_t fixedSize(uint64_t &)
+{
+    return 64u;
+}
+
+size_t randomSize(uint64_t &seed)
+{
+    return 16u + nextRandom(seed) % 4081u;
+}
+
+// Powers of two from 128 bytes to 64 KiB.
+size_t powerOfTwoSize(uint64_t &seed)
+{
+    return size_t{128u} << (nextRandom(seed) % 10u);
+}
+
+template <typename Backend, size_t (*SizeOf)(uint64_t &)>
+void runChurn(const char *scenario, size_t numThreads)
+{
+    std::vector<Samples> samples(numThreads, Samples(Ops));
+    std::vector<std::thread> threads;
+
+    const auto begin = Clock::now();
+
+    for (size_t i = 0u; i < numThreads; ++i)
+    {
+        threads.emplace_back([&samples, i] { churn<Backend>(samples[i], 42u + i, Ops, SizeOf); });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    const std::chrono::duration<double> elapsed = Clock::now() - begin;
+
+    for (size_t i = 1u; i < numThreads; ++i)
+    {
+        samples[0].merge(samples[i]);
+    }
+    report(scenario, Backend::Name, numThreads, samples[0], elapsed.count());
+}
+
+// One thread allocates, another frees what it receives through a single-producer ring.
+template <typename Backend>
+void runProducerConsumer()
+{
+    constexpr size_t RingSize = 4096u;
+
+    struct Item
+    {
+        char *ptr;
+        size_t size;
+    };
+
+    std::vector<Item> ring(RingSize);
+    std::atomic<size_t> head{0u};
+    std::atomic<size_t> tail{0u};
+
+    Samples produced(Ops);
+    Samples consumed(Ops);
+
+    const auto begin = Clock::now();
+
+    std::thread consumer([&] {
+        typename Backend::template Allocator<char> alloc;
+
+        for (size_t i = 0u; i < Ops; ++i)
+        {
+            while (tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+
+            const Item item = ring[i % RingSize];
+            tail.store(i + 1u, std::memory_order_release);
+            consumed.time([&] { alloc.deallocate(item.ptr, item.size); });
+        }
+    });
+
+    typename Backend::template Allocator<char> alloc;
+    uint64_t seed = 7u;
+
+    for (size_t i = 0u; i < Ops; ++i)
+    {
+        const size_t size = randomSize(seed);
+        char *ptr = nullptr;
+        produced.time([&] { ptr = alloc.allocate(size); });
+        ptr[0] = 1;
+
+        while (i - tail.load(std::memory_order_acquire) == RingSize)
+        {
+            std::this_thread::yield();
+        }
+
+        ring[i % RingSize] = {ptr, size};
+        head.store(i + 1u, std::memory_order_release);
+    }
+
+    consumer.join();
+    const std::chrono::duration<double> elapsed = Clock::now() - begin;
+
+    produced.merge(consumed);
+    report("producer-consumer", Backend::Name, 2u, produced, elapsed.count());
+}
+
+// Times whole container workloads, one sample per element operation.
+template <typename Backend>
+void runContainers()
+{
+    constexpr size_t Elements = 200000u;
+    using Value = uint64_t;
+
+    {
+        Samples samples(Elements);
+        const auto begin = Clock::now();
+
+        std::vector<Value, typename Backend::template Allocator<Value>> vector;
+        for (size_t i = 0u; i < Elements; ++i)
+        {
+            samples.time([&] { vector.push_back(i); });
+        }
+        report("vector", Backend::Name, 1u, samples, std::chrono::duration<double>(Clock::now() - begin).count());
+    }
+
+    {
+        Samples samples(2u * Elements);
+        const auto begin = Clock::now();
+
+        std::deque<Value, typename Backend::template Allocator<Value>> deque;
+        for (size_t i = 0u; i < Elements; ++i)
+        {
+            samples.time([&] { deque.push_back(i); });
+        }
+        for (size_t i = 0u; i < Elements; ++i)
+        {
+            samples.time([&] { deque.pop_front(); });
+        }
+        report("deque", Backend::Name, 1u, samples, std::chrono::duration<double>(Clock::now() - begin).count());
+    }
+
+    {
+        using Alloc = typename Backend::template Allocator<std::pair<const Value, Value>>;
+
+        Samples samples(2u * Elements);
+        uint64_t seed = 11u;
+        const auto begin = Clock::now();
+
+        std::map<Value, Value, std::less<Value>, Alloc> map;
+        for (size_t i = 0u; i < Elements; ++i)
+        {
+            const Value key = nextRandom(seed);
+            samples.time([&] { map.emplace(key, i); });
+        }
+        while (!map.empty())
+        {
+            samples.time([&] { map.erase(map.begin()); });
+        }
+        report("map", Backend::Name, 1u, samples, std::chrono::duration<double>(Clock::now() - begin).count());
+    }
+
+    {
+        Samples samples(2u * Elements);
+        uint64_t seed = 13u;
+        const auto begin = Clock::now();
+
+        std::list<Value, typename Backend::template Allocator<Value>> list;
+        for (size_t i = 0u; i < Elements; ++i)
+        {
+            samples.time([&] { (nextRandom(seed) & 1u) ? list.push_back(i) : list.push_front(i); });
+        }
+        while (!list.empty())
+        {
+            samples.time([&] { list.pop_back(); });
+        }
+        report("list", Backend::Name, 1u, samples, std::chrono::duration<double>(Clock::now() - begin).count());
+    }
+}
+
+template <typename Backend>
+void runAllocator(const std::vector<std::string> &filter)
+{
+    const auto selected = [&filter](const char *scenario) {
+        return filter.empty() || std::find(filter.begin(), filter.end(), scenario) != filter.end();
+    };
+
+    if (selected("fixed-churn"))
+    {
+        runChurn<Backend, fixedSize>("fixed-churn", 1u);
+    }
+    if (selected("random-churn"))
+    {
+        runChurn<Backend, randomSize>("random-churn", 1u);
+    }
+    if (selected("pow2-churn"))
+    {
+        runChurn<Backend, powerOfTwoSize>("pow2-churn", 1u);
+    }
+    if (selected("producer-consumer"))
+    {
+        runProducerConsumer<Backend>();
+    }
+    if (selected("containers"))
+    {
+        runContainers<Backend>();
+    }
+    if (selected("scaling"))
+    {
+        for (const size_t threads : {2u, 4u, 8u})
+        {
+            runChurn<Backend, randomSize>("scaling", threads);
+        }
+    }
+}
+
+// Free segment churn straight on a manager: fit, delete, and add back the remainder and a
+// released segment, the way a block drives it. TLSFSegmentManager keeps its lists inside the
+// segments, so it only runs inside blocks, as the avl-tlsf backend.
+template <typename Manager>
+void runManager(const char *backend)
+{
+    Manager manager;
+    uint64_t seed = 17u;
+    std::vector<SegmentManager::SegmentBase> freed;
+
+    for (size_t i = 0u; i < LiveSlots; ++i)
+    {
+        manager.addSegment({i * 8192u, 16u + (nextRandom(seed) % 512u) * 16u});
+    }
+
+    Samples samples(Ops);
+    const auto begin = Clock::now();
+
+    for (size_t i = 0u; i < Ops / 2u; ++i)
+    {
+        const size_t size = 16u + (nextRandom(seed) % 256u) * 16u;
+        SegmentManager::SegmentBase found;
+
+        samples.time([&] {
+            if (manager.fitSegment({0u, size}, found))
+            {
+                manager.deleteSegment(found);
+                if (found.size != size)
+                {
+                    manager.addSegment({found.head + size, found.size - size});
+                }
+            }
+        });
+
+        samples.time([&] { manager.addSegment({(LiveSlots + i) * 8192u, size}); });
+    }
+
+    report("segment-manager", backend, 1u, samples, std::chrono::duration<double>(Clock::now() - begin).count());
+}
+
+template <typename Tree>
+void runTree(const char *backend)
+{
+    Tree tree;
+    uint64_t seed = 19u;
+    std::vector<int64_t> keys(LiveSlots);
+
+    for (auto &key : keys)
+    {
+        key = static_cast<int64_t>(nextRandom(seed));
+        tree.insert(key);
+    }
+
+    Samples samples(Ops);
+    const auto begin = Clock::now();
+
+    for (size_t i = 0u; i < Ops / 2u; ++i)
+    {
+        int64_t &key = keys[nextRandom(seed) % LiveSlots];
+
+        if constexpr (std::is_same_v<Tree, std::multiset<int64_t>>)
+        {
+            samples.time([&] { tree.erase(tree.find(key)); });
+        }
+        else
+        {
+            samples.time([&] { tree.pop(key); });
+        }
+
+        key = static_cast<int64_t>(nextRandom(seed));
+        samples.time([&] { tree.insert(key); });
+    }
+
+    report("avltree", backend, 1u, samples, std::chrono::duration<double>(Clock::now() - begin).count());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> filter(argv + 1, argv + argc);
+
+    std::printf("scenario,backend,threads,ops,ops_per_sec,p50_ns,p99_ns,p999_ns\n");
+
+    runAllocator<AVLBackend>(filter);
+    runAllocator<TLSFAVLBackend>(filter);
+    runAllocator<BuddyAVLBackend>(filter);
+    runAllocator<CachedAVLBackend>(filter);
+    runAllocator<StdBackend>(filter);
+    runAllocator<MallocBackend>(filter);
+
+    if (filter.empty() || std::find(filter.begin(), filter.end(), "segment-manager") != filter.end())
+    {
+        runManager<SegmentManager>("dual-tree");
+        runManager<AugmentedSegmentManager>("augmented-first-fit");
+        runManager<BTreeSegmentManager>("btree");
+    }
+
+    if (filter.empty() || std::find(filter.begin(), filter.end(), "avltree") != filter.end())
+    {
+        runTree<AVLTree<int64_t>>("avltree");
+        runTree<BPlusTree<int64_t>>("bplus");
+        runTree<std::multiset<int64_t>>("std-multiset");
+    }
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "../include/AVLTree.hpp"
+#include "../include/BPlusTree.hpp"
+#include "../include/SegmentManager.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Compares AVLTree node layouts and BPlusTree on the key types the allocator uses.
+// Prints one CSV line per run:
+//     layout,key,keys,node_bytes,footprint_bytes,lookups_per_sec
+// Usage: avltree-bench [keys...]
+
+namespace
+{
+
+using Yaro::Utility::AVLTree;
+using Yaro::Utility::BPlusTree;
+using Yaro::Utility::CompactNodes;
+using Yaro::Utility::PooledNodes;
+using Yaro::Utility::SegmentManager;
+
+constexpr size_t Lookups = 4000000u;
+
+uint64_t nextRandom(uint64_t &state)
+{
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return state >> 17;
+}
+
+template <typename KeyType>
+KeyType makeKey(uint64_t value);
+
+template <>
+int64_t makeKey<int64_t>(uint64_t value)
+{
+    return static_cast<int64_t>(value);
+}
+
+template <>
+SegmentManager::Segment<SegmentManager::SizeHeavy> makeKey<SegmentManager::Segment<SegmentManager::SizeHeavy>>(uint64_t value)
+{
+    return {value * 16u, (value % 512u) * 16u};
+}
+
+template <typename Tree, typename KeyType>
+void measure(const char *layout, const char *keyName, size_t numKeys, size_t nodeBytes)
+{
+    std::vector<KeyType> keys;
+    keys.reserve(numKeys);
+
+    uint64_t state = numKeys;
+    for (size_t i = 0u; i < numKeys; ++i)
+    {
+        keys.push_back(makeKey<KeyType>(nextRandom(state)));
+    }
+
+    Tree tree;
+    for (const auto &key : keys)
+    {
+        tree.insert(key);
+    }
+
+    size_t found = 0u;
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (size_t i = 0u; i < Lookups; ++i)
+    {
+        found += tree.find(keys[nextRandom(state) % numKeys]);
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    if (found != Lookups)
+    {
+        std::fprintf(stderr, "lookup mismatch: %zu of %zu\n", found, Lookups);
+    }
+
+    std::printf("%s,%s,%zu,%zu,%zu,%.0f\n", layout, keyName, numKeys, nodeBytes, tree.memoryUsage(),
+                static_cast<double>(Lookups) / elapsed.count());
+}
+
+template <typename KeyType, template <typename> class Storage>
+void run(const char *layout, const char *keyName, size_t numKeys)
+{
+    using Tree = AVLTree<KeyType, Storage>;
+    measure<Tree, KeyType>(layout, keyName, numKeys, sizeof(typename Tree::Node));
+}
+
+// Node bytes are those of a leaf.
+template <typename KeyType>
+void runBPlusTree(const char *keyName, size_t numKeys)
+{
+    using Tree = BPlusTree<KeyType>;
+    measure<Tree, KeyType>("bplus", keyName, numKeys, Tree::leafSize());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i)
+    {
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+
+    if (sizes.empty())
+    {
+        sizes = {10000u, 100000u, 1000000u, 10000000u};
+    }
+
+    using Segment = SegmentManager::Segment<SegmentManager::SizeHeavy>;
+
+    std::printf("layout,key,keys,node_bytes,footprint_bytes,lookups_per_sec\n");
+
+    for (const size_t numKeys : sizes)
+    {
+        run<int64_t, PooledNodes>("pooled", "int64", numKeys);
+        run<int64_t, CompactNodes>("compact", "int64", numKeys);
+        runBPlusTree<int64_t>("int64", numKeys);
+        run<Segment, PooledNodes>("pooled", "segment", numKeys);
+        run<Segment, CompactNodes>("compact", "segment", numKeys);
+        runBPlusTree<Segment>("segment", numKeys);
+    }
+
+    return 0;
+}
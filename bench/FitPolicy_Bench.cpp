@@ -0,0 +1,152 @@
+#include "../include/AVLMemoryResource.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Compares the fit policies of SegmentManager on churn workloads, each on a resource of a single
+// block that the live set fills well enough for placement to matter. Each policy runs twice:
+// once timed, once sampling fragmentation every SampleInterval operations.
+// Prints one CSV line per run:
+//     workload,policy,ops,ops_per_sec,failures,peak_used_bytes,max_fragmentation,final_fragmentation
+
+namespace
+{
+
+using Yaro::Utility::Byte;
+using Yaro::Utility::FitPolicyAllocatorTraits;
+
+constexpr size_t Ops = 1000000u;
+constexpr size_t LiveSlots = 1024u;
+constexpr size_t SampleInterval = 1024u;
+
+uint64_t nextRandom(uint64_t &state)
+{
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return state >> 17;
+}
+
+struct Workload
+{
+    const char *name;
+    size_t blockSize;
+    // Picks the size of a new allocation in `slot`.
+    size_t (*sizeOf)(uint64_t &seed, size_t slot);
+    // Chance in 1024 that a live allocation in `slot` is freed when its slot comes up.
+    size_t (*freeOdds)(size_t slot);
+};
+
+size_t randomSize(uint64_t &seed, size_t)
+{
+    return 16u + nextRandom(seed) % 4081u;
+}
+
+size_t alwaysFree(size_t)
+{
+    return 1024u;
+}
+
+// Mostly small, short-lived allocations between a few large ones that stay for long.
+size_t mixedSize(uint64_t &seed, size_t slot)
+{
+    return (slot % 16u == 0u) ? 4096u + nextRandom(seed) % 61441u : 16u + nextRandom(seed) % 241u;
+}
+
+size_t mixedOdds(size_t slot)
+{
+    return (slot % 16u == 0u) ? 16u : 1024u;
+}
+
+const Workload Workloads[] = {
+    {"random-churn", size_t{3} << 19, randomSize, alwaysFree},
+    {"mixed-lifetime", size_t{3} << 20, mixedSize, mixedOdds},
+};
+
+struct Result
+{
+    size_t failures = 0u;
+    size_t peakUsedBytes = 0u;
+    double maxFragmentation = 0.0;
+    double finalFragmentation = 0.0;
+    double seconds = 0.0;
+};
+
+template <typename Traits>
+void churn(const Workload &workload, bool sample, Result &result)
+{
+    Yaro::Utility::AVLMemoryResource<Traits> resource(1u, workload.blockSize);
+
+    Byte *ptrs[LiveSlots] = {};
+    uint64_t seed = 42u;
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (size_t i = 0u; i < Ops; ++i)
+    {
+        const size_t slot = nextRandom(seed) % LiveSlots;
+
+        if (ptrs[slot] == nullptr)
+        {
+            ptrs[slot] = resource.tryAllocate(workload.sizeOf(seed, slot));
+            result.failures += (ptrs[slot] == nullptr) ? 1u : 0u;
+        }
+        else if (nextRandom(seed) % 1024u < workload.freeOdds(slot))
+        {
+            resource.release(ptrs[slot]);
+            ptrs[slot] = nullptr;
+        }
+
+        if (sample && i % SampleInterval == 0u)
+        {
+            result.maxFragmentation = std::max(result.maxFragmentation, resource.stats().total.fragmentation());
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    if (sample)
+    {
+        const auto stats = resource.stats();
+        result.peakUsedBytes = stats.total.peakUsedBytes;
+        result.finalFragmentation = stats.total.fragmentation();
+    }
+
+    for (Byte *ptr : ptrs)
+    {
+        if (ptr != nullptr)
+        {
+            resource.release(ptr);
+        }
+    }
+}
+
+template <typename FitPolicy>
+void run(const char *policy)
+{
+    for (const Workload &workload : Workloads)
+    {
+        Result timed;
+        Result sampled;
+
+        churn<FitPolicyAllocatorTraits<FitPolicy>>(workload, false, timed);
+        churn<FitPolicyAllocatorTraits<FitPolicy>>(workload, true, sampled);
+
+        std::printf("%s,%s,%zu,%.0f,%zu,%zu,%.4f,%.4f\n", workload.name, policy, Ops,
+                    static_cast<double>(Ops) / timed.seconds, timed.failures, sampled.peakUsedBytes,
+                    sampled.maxFragmentation, sampled.finalFragmentation);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("workload,policy,ops,ops_per_sec,failures,peak_used_bytes,max_fragmentation,final_fragmentation\n");
+
+    run<Yaro::Utility::BestFit>("best-fit");
+    run<Yaro::Utility::FirstFit>("first-fit");
+    run<Yaro::Utility::NextFit>("next-fit");
+    run<Yaro::Utility::WorstFit>("worst-fit");
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "../include/PageBuffer.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Measures dependent random loads over a block pool backed by normal or huge pages. Every load
+// lands on a different page in random order, so the run is dominated by TLB reach.
+// Prints one CSV line per run:
+//     pages,pool_bytes,huge_backed_bytes,loads_per_sec
+// Usage: pagebuffer-bench [pool MiB...]
+
+namespace
+{
+
+using Yaro::Utility::PageBuffer;
+
+constexpr size_t Loads = 20000000u;
+
+// Anonymous memory the kernel currently backs with transparent huge pages, or 0 where unknown.
+size_t hugeBackedBytes()
+{
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string field;
+    size_t kiloBytes = 0u;
+
+    while (smaps >> field)
+    {
+        if (field == "AnonHugePages:")
+        {
+            smaps >> kiloBytes;
+            break;
+        }
+    }
+
+    return kiloBytes * 1024u;
+}
+
+void run(const char *pages, size_t poolBytes, bool hugePages)
+{
+    PageBuffer pool(poolBytes, hugePages);
+
+    const size_t page = PageBuffer::pageSize();
+    const size_t numPages = poolBytes / page;
+
+    // Sattolo's shuffle gives a single cycle through every page.
+    std::vector<uint64_t> order(numPages);
+    for (size_t i = 0u; i < numPages; ++i)
+    {
+        order[i] = i;
+    }
+
+    uint64_t state = 12345u;
+    for (size_t i = numPages - 1u; i > 0u; --i)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        std::swap(order[i], order[(state >> 33) % i]);
+    }
+
+    // Each page holds its link on a different cache line, so lines do not alias in the caches.
+    const auto slot = [page](uint64_t index) -> uint64_t { return index * page + (index * 64u) % page; };
+
+    for (size_t i = 0u; i < numPages; ++i)
+    {
+        const uint64_t next = slot(order[i]);
+        std::memcpy(&pool[slot(i)], &next, sizeof(next));
+    }
+
+    const size_t huge = hugeBackedBytes();
+
+    uint64_t offset = 0u;
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (size_t i = 0u; i < Loads; ++i)
+    {
+        std::memcpy(&offset, &pool[offset], sizeof(offset));
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    std::printf("%s,%zu,%zu,%.0f\n", pages, poolBytes, huge, static_cast<double>(Loads) / elapsed.count());
+
+    if (offset == ~uint64_t{0u})
+    {
+        std::printf("\n");
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i)
+    {
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10) << 20);
+    }
+
+    if (sizes.empty())
+    {
+        sizes = {size_t{64} << 20, size_t{512} << 20};
+    }
+
+    std::printf("pages,pool_bytes,huge_backed_bytes,loads_per_sec\n");
+
+    for (const size_t poolBytes : sizes)
+    {
+        run("normal", poolBytes, false);
+        run("huge", poolBytes, true);
+    }
+
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include "../include/AllocationTrace.hpp"
+#include "../include/AVLMemoryResource.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+// Replays a trace written by AllocationTrace against every segment manager, every fit policy,
+// buddy blocks and std::allocator, in timestamp order on a single thread. Each backend runs
+// twice: once timed, once sampling its statistics every SampleInterval events.
+// Prints one CSV line per backend:
+//     backend,events,failures,seconds,peak_live_bytes,peak_used_bytes,max_fragmentation,final_fragmentation
+// Usage: trace-replay <trace> [blocks] [block MiB]
+
+namespace
+{
+
+using Yaro::Utility::AllocationTrace;
+using Yaro::Utility::Byte;
+using Yaro::Utility::FitPolicyAllocatorTraits;
+using Yaro::Utility::TraceEvent;
+using Yaro::Utility::TraceRecord;
+
+constexpr size_t SampleInterval = 1024u;
+
+// A traced allocation as the backend holds it. `base` and `baseSize` are what it was allocated
+// as; released heads move `ptr` forward.
+struct Live
+{
+    Byte *base;
+    size_t baseSize;
+    Byte *ptr;
+    size_t size;
+};
+
+template <typename Traits>
+class ResourceBackend
+{
+  public:
+    ResourceBackend(size_t numBlocks, size_t blockSize)
+        : m_resource(numBlocks, blockSize)
+    {
+    }
+
+    Byte *allocate(size_t size)
+    {
+        return m_resource.tryAllocate(size);
+    }
+
+    void release(Live &live)
+    {
+        m_resource.release(live.ptr);
+    }
+
+    // Slab objects cannot give back their head, so those stay whole until their last part is
+    // released, as with std::allocator.
+    void trim(Live &live, size_t count)
+    {
+        try
+        {
+            live.ptr = m_resource.release(live.ptr, count);
+        }
+        catch (const std::bad_alloc &)
+        {
+        }
+    }
+
+    bool resize(Live &live, size_t size)
+    {
+        return m_resource.tryResize(live.ptr, size);
+    }
+
+    size_t peakUsedBytes()
+    {
+        return m_resource.stats().total.peakUsedBytes;
+    }
+
+    // Free memory spread over blocks is not fragmentation, so the worst block counts.
+    double fragmentation()
+    {
+        double worst = 0.0;
+        for (const auto &block : m_resource.stats().blocks)
+        {
+            worst = std::max(worst, block.fragmentation());
+        }
+        return worst;
+    }
+
+  private:
+    Yaro::Utility::AVLMemoryResource<Traits> m_resource;
+};
+
+// std::allocator cannot release the head of an allocation, so a trimmed allocation stays whole
+// until its last part is released. It reports no used bytes or fragmentation.
+class StdBackend
+{
+  public:
+    StdBackend(size_t, size_t)
+    {
+    }
+
+    Byte *allocate(size_t size)
+    {
+        return m_alloc.allocate(std::max<size_t>(size, 1u));
+    }
+
+    void release(Live &live)
+    {
+        m_alloc.deallocate(live.base, std::max<size_t>(live.baseSize, 1u));
+    }
+
+    void trim(Live &live, size_t count)
+    {
+        live.ptr += count;
+    }
+
+    bool resize(Live &, size_t)
+    {
+        return false;
+    }
+
+    size_t peakUsedBytes()
+    {
+        return 0u;
+    }
+
+    double fragmentation()
+    {
+        return 0.0;
+    }
+
+  private:
+    std::allocator<Byte> m_alloc;
+};
+
+struct Result
+{
+    size_t failures = 0u;
+    size_t peakLiveBytes = 0u;
+    size_t peakUsedBytes = 0u;
+    double maxFragmentation = 0.0;
+    double finalFragmentation = 0.0;
+    double seconds = 0.0;
+};
+
+template <typename Backend>
+void replay(Backend &backend, const std::vector<TraceRecord> &records, bool sample, Result &result)
+{
+    std::unordered_map<uint64_t, Live> live;
+    live.reserve(records.size());
+
+    size_t liveBytes = 0u;
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (size_t i = 0u; i < records.size(); ++i)
+    {
+        const TraceRecord &record = records[i];
+
+        if (record.event == TraceEvent::Allocate)
+        {
+            if (Byte *ptr = backend.allocate(record.size))
+            {
+                live[record.pointer] = {ptr, record.size, ptr, record.size};
+                liveBytes += record.size;
+                result.peakLiveBytes = std::max(result.peakLiveBytes, liveBytes);
+            }
+            else
+            {
+                ++result.failures;
+            }
+        }
+        else if (auto found = live.find(record.pointer); found != live.end())
+        {
+            Live entry = found->second;
+            live.erase(found);
+
+            if (record.event == TraceEvent::Deallocate && (record.size == 0u || record.size >= entry.size))
+            {
+                backend.release(entry);
+                liveBytes -= entry.size;
+            }
+            else if (record.event == TraceEvent::Deallocate)
+            {
+                backend.trim(entry, record.size);
+                entry.size -= record.size;
+                liveBytes -= record.size;
+                live[record.pointer + record.size] = entry;
+            }
+            else
+            {
+                // A resize that does not fit in this backend moves instead.
+                if (!backend.resize(entry, record.size))
+                {
+                    Byte *ptr = backend.allocate(record.size);
+
+                    if (ptr == nullptr)
+                    {
+                        ++result.failures;
+                        live[record.pointer] = entry;
+                        continue;
+                    }
+
+                    backend.release(entry);
+                    entry = {ptr, record.size, ptr, entry.size};
+                }
+
+                liveBytes = liveBytes - entry.size + record.size;
+                result.peakLiveBytes = std::max(result.peakLiveBytes, liveBytes);
+                entry.size = record.size;
+                live[record.pointer] = entry;
+            }
+        }
+
+        if (sample && i % SampleInterval == 0u)
+        {
+            result.maxFragmentation = std::max(result.maxFragmentation, backend.fragmentation());
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    if (sample)
+    {
+        result.peakUsedBytes = backend.peakUsedBytes();
+        result.finalFragmentation = backend.fragmentation();
+    }
+
+    for (auto &entry : live)
+    {
+        backend.release(entry.second);
+    }
+}
+
+template <typename Backend>
+void run(const char *name, const std::vector<TraceRecord> &records, size_t numBlocks, size_t blockSize)
+{
+    Result timed;
+    Result sampled;
+
+    {
+        Backend backend(numBlocks, blockSize);
+        replay(backend, records, false, timed);
+    }
+    {
+        Backend backend(numBlocks, blockSize);
+        replay(backend, records, true, sampled);
+    }
+
+    std::printf("%s,%zu,%zu,%.6f,%zu,%zu,%.4f,%.4f\n", name, records.size(), timed.failures, timed.seconds,
+                sampled.peakLiveBytes, sampled.peakUsedBytes, sampled.maxFragmentation, sampled.finalFragmentation);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <trace> [blocks] [block MiB]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<TraceRecord> records;
+    if (!AllocationTrace::read(argv[1], records))
+    {
+        std::fprintf(stderr, "cannot read trace %s\n", argv[1]);
+        return 1;
+    }
+
+    const size_t numBlocks = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 4u;
+    const size_t blockSize = ((argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 256u) << 20;
+
+    // Buffers of different threads were written as they filled up.
+    std::stable_sort(records.begin(), records.end(),
+                     [](const TraceRecord &a, const TraceRecord &b) { return a.time < b.time; });
+
+    std::printf("backend,events,failures,seconds,peak_live_bytes,peak_used_bytes,max_fragmentation,final_fragmentation\n");
+
+    run<ResourceBackend<Yaro::Utility::DefaultAllocatorTraits>>("dual-tree", records, numBlocks, blockSize);
+    run<ResourceBackend<Yaro::Utility::AugmentedFirstFitAllocatorTraits>>("augmented-first-fit", records, numBlocks,
+                                                                          blockSize);
+    run<ResourceBackend<Yaro::Utility::BTreeAllocatorTraits>>("btree", records, numBlocks, blockSize);
+    run<ResourceBackend<Yaro::Utility::TLSFAllocatorTraits>>("tlsf", records, numBlocks, blockSize);
+    run<ResourceBackend<Yaro::Utility::BuddyAllocatorTraits>>("buddy", records, numBlocks, blockSize);
+    run<ResourceBackend<FitPolicyAllocatorTraits<Yaro::Utility::FirstFit>>>("first-fit", records, numBlocks, blockSize);
+    run<ResourceBackend<FitPolicyAllocatorTraits<Yaro::Utility::NextFit>>>("next-fit", records, numBlocks, blockSize);
+    run<ResourceBackend<FitPolicyAllocatorTraits<Yaro::Utility::WorstFit>>>("worst-fit", records, numBlocks, blockSize);
+    run<StdBackend>("std", records, numBlocks, blockSize);
+
+    return 0;
+}
@@ -1,12 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
-#include <unordered_map>
-#include <vector>
-#include <shared_mutex>
-#include <atomic>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
 
-#include "AVLTree.hpp"
+#include "AllocationTrace.hpp"
+#include "AVLMemoryResource.hpp"
 
 namespace Yaro
 {
@@ -15,368 +17,219 @@ namespace Utility
 
 using Byte = unsigned char;
 
-class SegmentManager
+// Handle to an AVLMemoryResource. A default constructed allocator uses the arena shared by its
+// block sizes and traits; one constructed from a resource uses that resource, which must outlive it.
+template <typename T, size_t NumBlocks, size_t BlockSize, typename Traits = DefaultAllocatorTraits>
+class AVLAllocator
 {
-  public:
-    struct SegmentBase
-    {
-        size_t head;
-        size_t size;
+    using Arena = AVLArena<NumBlocks, BlockSize, Traits>;
+    using Cache = typename Arena::Cache;
 
-        SegmentBase()
-            : SegmentBase{0u, 0u}
-        {
-        }
+    // Cached segments only promise the block granularity as alignment.
+    static constexpr bool UseCache = Traits::UseThreadCache && alignof(T) <= Arena::Resource::Block::Granularity;
 
-        SegmentBase(size_t head, size_t size)
-        {
-            this->head = head;
-            this->size = size;
-        }
-
-        bool operator==(const SegmentBase &other)
-        {
-            return head == other.head && size == other.size;
-        }
-    };
-
-    struct HeadHeavy : public SegmentBase
-    {
-        size_t compareBy() const
-        {
-            return head;
-        }
-        void setCompared(size_t val)
-        {
-            head = val;
-        }
-
-        virtual ~HeadHeavy() = default;
-    };
-
-    struct SizeHeavy : public SegmentBase
-    {
-        size_t compareBy() const
-        {
-            return size;
-        }
-        void setCompared(size_t val)
-        {
-            size = val;
-        }
+  public:
+    using Resource = typename Arena::Resource;
 
-        virtual ~SizeHeavy() = default;
-    };
+    using value_type = T;
+    using pointer = value_type *;
+    using const_pointer = const value_type *;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
 
-    template <typename ComparisonStrategy>
-    struct Segment : public ComparisonStrategy
+    pointer allocate(size_t n)
     {
-        bool operator==(const Segment &other) const noexcept
-        {
-            return ComparisonStrategy::compareBy() == other.ComparisonStrategy::compareBy();
-        }
-        bool operator!=(const Segment &other) const noexcept
-        {
-            return ComparisonStrategy::compareBy() != other.ComparisonStrategy::compareBy();
-        }
+        const size_t byteSize = sizeof(T) * n;
 
-        bool operator<(const Segment &other) const noexcept
+        if constexpr (UseCache)
         {
-            return ComparisonStrategy::compareBy() < other.ComparisonStrategy::compareBy();
-        }
-        bool operator>(const Segment &other) const noexcept
-        {
-            return ComparisonStrategy::compareBy() > other.ComparisonStrategy::compareBy();
-        }
-
-        bool operator<=(const Segment &other) const noexcept
-        {
-            return ComparisonStrategy::compareBy() <= other.ComparisonStrategy::compareBy();
-        }
-        bool operator>=(const Segment &other) const noexcept
-        {
-            return ComparisonStrategy::compareBy() >= other.ComparisonStrategy::compareBy();
+            if (Cache::cacheable(byteSize) && _usesArena())
+            {
+                Byte *ptr = Cache::local().allocate(byteSize);
+                _trace(TraceEvent::Allocate, ptr, byteSize);
+                return reinterpret_cast<pointer>(ptr);
+            }
         }
 
-        Segment operator-(const Segment &other) const noexcept
-        {
-            Segment segment{other};
-            auto cmp = std::max(ComparisonStrategy::compareBy(), other.ComparisonStrategy::compareBy()) -
-                       std::min(ComparisonStrategy::compareBy(), other.ComparisonStrategy::compareBy());
-            segment.ComparisonStrategy::setCompared(cmp);
-
-            return segment;
-        }
+        Byte *ptr = m_resource->tryAllocate(byteSize, alignof(T));
 
-        static Segment abs(Segment val)
+        if (ptr == nullptr)
         {
-            return val;
-        }
-
-        static Segment max()
-        {
-            Segment dummy;
-            dummy.ComparisonStrategy::setCompared(std::numeric_limits<size_t>::max());
-            return dummy;
+            throw std::bad_alloc();
         }
 
-        Segment()
-            : Segment(0u, 0u){};
+        _trace(TraceEvent::Allocate, ptr, byteSize);
+        return reinterpret_cast<pointer>(ptr);
+    }
 
-        Segment(const SegmentBase &segment)
-            : Segment(segment.head, segment.size)
+    // Like allocate(), but the address is a multiple of `alignment`, which must be a power of two.
+    // Any padding in front of it stays in the block as free space. Released with deallocate().
+    // Sizes the thread cache serves take a whole bucket, since deallocate() may hand them to it.
+    pointer allocate_aligned(size_t n, size_t alignment)
+    {
+        if (alignment == 0u || (alignment & (alignment - 1u)) != 0u)
         {
+            throw std::bad_alloc();
         }
 
-        Segment(size_t head, size_t size)
-        {
-            this->head = head;
-            this->size = size;
-        }
+        size_t byteSize = sizeof(T) * n;
 
-        Segment(const Segment &other)
+        if constexpr (UseCache)
         {
-            this->head = other.head;
-            this->size = other.size;
-        }
+            if (Cache::cacheable(byteSize) && _usesArena())
+            {
+                if (alignment <= Arena::Resource::Block::Granularity)
+                {
+                    return allocate(n);
+                }
 
-        Segment &operator=(const Segment &other)
-        {
-            this->head = other.head;
-            this->size = other.size;
-            return *this;
+                byteSize = Cache::bucketSize(byteSize);
+            }
         }
 
-        Segment(Segment &&rr)
-        {
-            this->head = rr.head;
-            this->size = rr.size;
-        }
+        Byte *ptr = m_resource->tryAllocate(byteSize, std::max(alignment, alignof(T)));
 
-        Segment &operator=(Segment &&rr)
+        if (ptr == nullptr)
         {
-            this->head = rr.head;
-            this->size = rr.size;
-            return *this;
+            throw std::bad_alloc();
         }
-    };
-    void addSegment(const SegmentBase &segment)
-    {
-        m_sizeHeavySegments.insert(segment);
-        m_headHeavySegments.insert(segment);
-    }
-
-    bool deleteSegment(const SegmentBase &segment)
-    {
-        return m_headHeavySegments.pop(segment) && m_sizeHeavySegments.pop(segment);
-    }
-
-    bool bestFitSegment(const SegmentBase &segment, SegmentBase &outSegment)
-    {
-        return m_sizeHeavySegments.findClosestGreaterEqual(segment, static_cast<Segment<SizeHeavy> &>(outSegment));
-    }
-
-    bool getLeftAdjacentSegment(const SegmentBase &segment, SegmentBase &outSegment)
-    {
-        return m_headHeavySegments.findClosestLesser(segment, static_cast<Segment<HeadHeavy> &>(outSegment));
-    }
 
-    bool getRightAdjacentSegment(const SegmentBase &segment, SegmentBase &outSegment)
-    {
-        return m_headHeavySegments.findClosestGreater(segment, static_cast<Segment<HeadHeavy> &>(outSegment));
+        _trace(TraceEvent::Allocate, ptr, sizeof(T) * n);
+        return reinterpret_cast<pointer>(ptr);
     }
 
-    size_t maxSizeSegment()
+    pointer deallocate(T *ptr, size_t count = 0u)
     {
-        SegmentBase segment;
+        _trace(TraceEvent::Deallocate, ptr, sizeof(T) * count);
 
-        if (m_sizeHeavySegments.findMax(static_cast<Segment<SizeHeavy> &>(segment)))
+        if constexpr (UseCache)
         {
-            return segment.size;
+            if (Cache::cacheable(sizeof(T) * count) && _usesArena())
+            {
+                Cache::local().deallocate(reinterpret_cast<Byte *>(ptr), sizeof(T) * count);
+                return nullptr;
+            }
         }
 
-        return 0u;
+        return reinterpret_cast<pointer>(m_resource->release(reinterpret_cast<Byte *>(ptr), sizeof(T) * count));
     }
 
-  private:
-    AVLTree<Segment<HeadHeavy>> m_headHeavySegments;
-    AVLTree<Segment<SizeHeavy>> m_sizeHeavySegments;
-};
-
-template <size_t BlockSize>
-struct MemoryBlock
-{
-    using Bytes = std::vector<Byte>;
-
-    SegmentManager manager;
-    Bytes pool;
-
-    MemoryBlock()
-        : pool(BlockSize, ' ')
+    // Resizes the allocation at `ptr` from `oldN` to `newN` elements without moving it. Fails
+    // if the free space behind it is too small, or if either size is served by the thread cache.
+    bool try_expand(pointer ptr, size_t oldN, size_t newN)
     {
-        manager.addSegment({0u, BlockSize});
-    }
-
-    MemoryBlock(const MemoryBlock &other) = delete;
-    MemoryBlock &operator=(const MemoryBlock &other) = delete;
-    MemoryBlock(MemoryBlock &&rr) = delete;
-    MemoryBlock &operator=(MemoryBlock &&rr) = delete;
-};
-
-template <typename T, size_t NumBlocks, size_t BlockSize>
-class AVLAllocator
-{
-  public:
-    using value_type = T;
-    using pointer = value_type *;
-    using const_pointer = const value_type *;
-    using reference = value_type &;
-    using const_reference = const value_type &;
-    using size_type = size_t;
-    using difference_type = ptrdiff_t;
-
-    using SegmentAndBlockId = std::pair<SegmentManager::SegmentBase, size_t>;
-
-    static inline std::atomic_uint8_t start = 0u;
-
-    pointer allocate(size_t n)
-    {
-        std::lock_guard<std::mutex> lk(s_mutex);
-        size_t byteSize = sizeof(T) * n;
-        for (size_t i = 0u; i < NumBlocks; ++i)
+        if constexpr (UseCache)
         {
-            size_t blockId = i % NumBlocks;
-            auto &block = s_blocks[blockId];
-
-            SegmentManager::SegmentBase dummy{0, byteSize};
-            SegmentManager::SegmentBase bestSegment;
-
-            if (!block.manager.bestFitSegment(dummy, bestSegment))
-            {
-                continue;
-            }
-
-            dummy.head = bestSegment.head + byteSize;
-            dummy.size = bestSegment.size - byteSize;
-
-            block.manager.deleteSegment(bestSegment);
-
-            if (byteSize != bestSegment.size)
-            {
-                block.manager.addSegment(dummy);
-            }
-
-            T *ptr = reinterpret_cast<T *>(&block.pool[bestSegment.head]);
-
-            if(s_pointerSegmentMapping.find(ptr) != s_pointerSegmentMapping.end())
+            if ((Cache::cacheable(sizeof(T) * oldN) || Cache::cacheable(sizeof(T) * newN)) && _usesArena())
             {
-                std::cout << "WTF!\n";
+                return false;
             }
+        }
 
-            s_pointerSegmentMapping.insert({ptr, {{bestSegment.head, byteSize}, blockId}});
-
-            return ptr;
+        if (!m_resource->tryResize(reinterpret_cast<Byte *>(ptr), sizeof(T) * newN))
+        {
+            return false;
         }
 
-        throw std::bad_alloc();
+        _trace(TraceEvent::Resize, ptr, sizeof(T) * newN);
+        return true;
     }
 
-    pointer deallocate(T *ptr, size_t count = 0u)
+    // Resizes in place when possible and otherwise moves the first min(oldN, newN) elements to a
+    // new allocation byte by byte, so T must be trivially copyable.
+    pointer reallocate(pointer ptr, size_t oldN, size_t newN)
     {
-        std::lock_guard<std::mutex> lock(s_mutex);
+        static_assert(std::is_trivially_copyable<T>::value, "reallocate() moves elements with memcpy");
 
-        count *= sizeof(T);
-        size_t size = 0u;
-    
-        auto it = s_pointerSegmentMapping.find(ptr);
-        if (it == s_pointerSegmentMapping.end())
+        if (try_expand(ptr, oldN, newN))
         {
-            std::cout << "Leak on: " << (void*)ptr << std::endl;
-            throw std::bad_alloc();
-            return nullptr;
+            return ptr;
         }
 
-        size_t blockId = it->second.second;
-        auto &block = s_blocks[blockId];
-        
-        SegmentManager::SegmentBase segment = it->second.first;
+        pointer moved = allocate(newN);
+        std::memcpy(moved, ptr, sizeof(T) * std::min(oldN, newN));
+        deallocate(ptr, oldN);
 
-        s_pointerSegmentMapping.erase(it);
+        return moved;
+    }
 
-        if (count > segment.size)
+    // Allocates `n` arrays, the i-th of them holding `counts[i]` elements, with one lock
+    // acquisition per block visited. Either fills all of `out` or releases what it got and
+    // throws std::bad_alloc. Bypasses the thread cache; release with deallocate_bulk() or deallocate(ptr).
+    void allocate_bulk(const size_t *counts, pointer *out, size_t n)
+    {
+        const size_t received = m_resource->tryAllocateBulk(counts, out, n, sizeof(T), alignof(T));
+
+        if (received != n)
         {
+            m_resource->releaseBulk(out, received);
             throw std::bad_alloc();
         }
-        else if (count != 0u && count != segment.size)
-        {
-            SegmentManager::SegmentBase remainder = {segment.head + count, segment.size - count};
-            s_pointerSegmentMapping.insert({ptr + count, {remainder, blockId}});
 
-            SegmentManager::SegmentBase freedSegment = {segment.head, count};
-            block.manager.addSegment(freedSegment);
-        }
-        else
+        for (size_t i = 0u; i < n; ++i)
         {
-            block.manager.addSegment(segment);
+            _trace(TraceEvent::Allocate, out[i], sizeof(T) * counts[i]);
         }
+    }
 
-        static auto mergeSegments = [&block](SegmentManager::SegmentBase &mergeInto,
-                                            SegmentManager::SegmentBase &mergeWhat) -> void {
-            auto &leftSegment = (mergeInto.head < mergeWhat.head) ? mergeInto : mergeWhat;
-            auto &rightSegment = (mergeInto.head > mergeWhat.head) ? mergeInto : mergeWhat;
-
-            block.manager.deleteSegment(leftSegment);
-            block.manager.deleteSegment(rightSegment);
-
-            leftSegment.size += rightSegment.size;
-
-            block.manager.addSegment(leftSegment);
-        };
-
-        SegmentManager::SegmentBase leftSegment, rightSegment;
-
-        if (block.manager.getLeftAdjacentSegment(segment, leftSegment))
+    // Releases `n` whole allocations, sorting `ptrs` by address so adjacent ones coalesce in one pass.
+    void deallocate_bulk(pointer *ptrs, size_t n)
+    {
+        for (size_t i = 0u; i < n; ++i)
         {
-            mergeSegments(segment, leftSegment);
+            _trace(TraceEvent::Deallocate, ptrs[i], 0u);
         }
 
-        if (block.manager.getRightAdjacentSegment(segment, rightSegment) && (!count || count == segment.size))
-        {
-            mergeSegments(segment, rightSegment);
-        }
-        size = segment.size;
-    
-        return (count == size) ? nullptr : ptr + count;
+        m_resource->releaseBulk(ptrs, n);
     }
 
-    AVLAllocator() = default;
+    AVLAllocator()
+        : m_resource{&Arena::shared()}
+    {
+    }
+
+    AVLAllocator(Resource &resource)
+        : m_resource{&resource}
+    {
+    }
 
     template <typename U>
-    AVLAllocator(const AVLAllocator<U, NumBlocks, BlockSize> &other)
+    AVLAllocator(const AVLAllocator<U, NumBlocks, BlockSize, Traits> &other)
+        : m_resource{other.resource()}
     {
     }
 
     template <typename U>
-    AVLAllocator &operator=(const AVLAllocator<U, NumBlocks, BlockSize> &other)
+    AVLAllocator &operator=(const AVLAllocator<U, NumBlocks, BlockSize, Traits> &other)
     {
+        m_resource = other.resource();
         return *this;
     }
 
     template <typename U>
-    AVLAllocator(AVLAllocator<U, NumBlocks, BlockSize> &&rr)
+    AVLAllocator(AVLAllocator<U, NumBlocks, BlockSize, Traits> &&rr)
+        : m_resource{rr.resource()}
     {
     }
 
     template <typename U>
-    AVLAllocator &operator=(AVLAllocator<U, NumBlocks, BlockSize> &&rr)
+    AVLAllocator &operator=(AVLAllocator<U, NumBlocks, BlockSize, Traits> &&rr)
     {
+        m_resource = rr.resource();
         return *this;
     }
 
+    Resource *resource() const
+    {
+        return m_resource;
+    }
+
     template <typename U>
     struct rebind
     {
-        using other = AVLAllocator<U, NumBlocks, BlockSize>;
+        using other = AVLAllocator<U, NumBlocks, BlockSize, Traits>;
     };
 
     template<typename... Args>
@@ -387,26 +240,44 @@ class AVLAllocator
 
     size_type max_size()
     {
-        std::lock_guard<std::mutex> lock(s_mutex);
-        size_type maxSize = 0u;
+        return m_resource->maxAllocation() / sizeof(value_type);
+    }
+
+    // Allocators of one resource can release what any other one allocated.
+    template <typename U>
+    bool operator==(const AVLAllocator<U, NumBlocks, BlockSize, Traits> &other) const
+    {
+        return m_resource == other.resource();
+    }
+
+    template <typename U>
+    bool operator!=(const AVLAllocator<U, NumBlocks, BlockSize, Traits> &other) const
+    {
+        return m_resource != other.resource();
+    }
 
-        for (const auto &block : s_blocks)
+  private:
+    static void _trace(TraceEvent event, const void *ptr, size_t byteSize)
+    {
+        if constexpr (Traits::RecordTrace)
         {
-            maxSize = std::max(maxSize, block.manager.maxSizeSegment());
+            AllocationTrace::record(event, ptr, byteSize);
         }
-        return maxSize / sizeof(value_type);
     }
 
-  private:
-    static inline std::array<MemoryBlock<BlockSize>, NumBlocks> s_blocks = std::array<MemoryBlock<BlockSize>, NumBlocks>{};
-    static inline std::unordered_map<T *, SegmentAndBlockId> s_pointerSegmentMapping = std::unordered_map<T *, SegmentAndBlockId>{};
-    static inline std::mutex s_mutex;
+    // The thread cache belongs to the shared arena and never holds segments of other resources.
+    bool _usesArena() const
+    {
+        return m_resource == &Arena::shared();
+    }
+
+    Resource *m_resource;
 };
 
 template<typename T, typename Alloc, typename... Args>
 std::shared_ptr<T> allocMakeShared(Alloc alloc, Args&&... args)
 {
-    return std::shared_ptr<T>(alloc.create(std::forward<Args>(args)...), [&alloc](typename Alloc::pointer p)->void {alloc.deallocate(p);});
+    return std::shared_ptr<T>(alloc.create(std::forward<Args>(args)...), [alloc](typename Alloc::pointer p) mutable -> void {alloc.deallocate(p);});
 }
 
 } // namespace Utility
@@ -0,0 +1,776 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "AllocatorStats.hpp"
+#include "AugmentedSegmentManager.hpp"
+#include "BlockIndex.hpp"
+#include "BuddyBlock.hpp"
+#include "MemoryBlock.hpp"
+#include "SegmentManager.hpp"
+#include "ThreadCache.hpp"
+#include "TLSFSegmentManager.hpp"
+
+namespace Yaro
+{
+namespace Utility
+{
+
+struct DefaultAllocatorTraits
+{
+    // Serve small requests from per-thread free lists instead of the shared blocks.
+    // Cacheable sizes are released with deallocate(ptr, n) only; the head-trimming form
+    // is then reserved for sizes above ThreadCache::MaxSize.
+    static constexpr bool UseThreadCache = false;
+
+    // Index of free segments inside a block.
+    using Manager = SegmentManager;
+
+    // Run blocks as buddy systems instead of tagged segments indexed by Manager.
+    static constexpr bool UseBuddySystem = false;
+
+    // Back block pools with 2 MB pages where the system provides them.
+    static constexpr bool UseHugePages = false;
+
+    // Report every allocator call to AllocationTrace while a trace is open.
+    static constexpr bool RecordTrace = false;
+
+    // Blocks the arena may grow to once its initial ones run out; 0 keeps their number fixed.
+    static constexpr size_t MaxBlocks = 0u;
+
+    // How long a block added on demand has to stay empty before it is retired.
+    static constexpr unsigned RetireDelayMs = 1000u;
+};
+
+struct ThreadCachedAllocatorTraits : public DefaultAllocatorTraits
+{
+    static constexpr bool UseThreadCache = true;
+};
+
+// Places requests at the lowest address that fits, the search the augmented tree answers along a
+// single path. Every other manager places them by best fit.
+struct AugmentedFirstFitAllocatorTraits : public DefaultAllocatorTraits
+{
+    using Manager = AugmentedSegmentManager;
+};
+
+struct BTreeAllocatorTraits : public DefaultAllocatorTraits
+{
+    using Manager = BTreeSegmentManager;
+};
+
+// Places requests with one of the fit policies of SegmentManager.hpp instead of best fit.
+template <typename FitPolicy>
+struct FitPolicyAllocatorTraits : public DefaultAllocatorTraits
+{
+    using Manager = BasicSegmentManager<CompactAVLTree, FitPolicy>;
+};
+
+// Constant-time fits for threads that need a bound on allocation latency, at the cost of
+// sometimes taking a larger segment than best fit would.
+struct TLSFAllocatorTraits : public DefaultAllocatorTraits
+{
+    using Manager = TLSFSegmentManager;
+};
+
+// Power-of-two segments split and merged with their buddies, for workloads whose requests are
+// mostly powers of two. Other sizes are rounded up to the next one.
+struct BuddyAllocatorTraits : public DefaultAllocatorTraits
+{
+    static constexpr bool UseBuddySystem = true;
+};
+
+struct HugePageAllocatorTraits : public DefaultAllocatorTraits
+{
+    static constexpr bool UseHugePages = true;
+};
+
+struct TracedAllocatorTraits : public DefaultAllocatorTraits
+{
+    static constexpr bool RecordTrace = true;
+};
+
+struct GrowingAllocatorTraits : public DefaultAllocatorTraits
+{
+    static constexpr size_t MaxBlocks = 64u;
+};
+
+template <size_t NumBlocks, size_t BlockSize, typename Traits>
+class AVLArena;
+
+// A set of blocks with its own state, usable directly, through AVLAllocator handles or as a
+// std::pmr::memory_resource. Independent resources never share blocks or locks.
+//
+// A resource given more `maxBlocks` than `numBlocks` adds blocks when none of its blocks can
+// serve a request. Blocks beyond the initial number that stay empty for `retireDelay` are
+// retired: their pages go back to the system and they sit out allocation until the resource
+// needs to grow again. Retired blocks keep their address range, so lookups never race with them.
+template <typename Traits = DefaultAllocatorTraits>
+class AVLMemoryResource : public std::pmr::memory_resource
+{
+    using Clock = std::chrono::steady_clock;
+
+  public:
+    using Block = std::conditional_t<Traits::UseBuddySystem, BuddyBlock<Traits::UseHugePages>,
+                                     MemoryBlock<typename Traits::Manager, Traits::UseHugePages>>;
+
+    AVLMemoryResource(size_t numBlocks, size_t blockSize, size_t maxBlocks = 0u,
+                      std::chrono::milliseconds retireDelay = std::chrono::milliseconds{Traits::RetireDelayMs})
+        : m_blocks{new std::atomic<Block *>[std::max(numBlocks, maxBlocks)]()}, m_blockSize{blockSize},
+          m_minBlocks{numBlocks}, m_maxBlocks{std::max(numBlocks, maxBlocks)}, m_retireDelay{retireDelay},
+          m_index{m_maxBlocks}, m_activeBlocks{numBlocks}
+    {
+        try
+        {
+            for (size_t i = 0u; i < numBlocks; ++i)
+            {
+                m_blocks[i].store(new Block(blockSize), std::memory_order_relaxed);
+                m_numBlocks.store(i + 1u, std::memory_order_release);
+                _publish(i);
+            }
+        }
+        catch (...)
+        {
+            _destroyBlocks();
+            throw;
+        }
+    }
+
+    AVLMemoryResource(const AVLMemoryResource &other) = delete;
+    AVLMemoryResource &operator=(const AVLMemoryResource &other) = delete;
+
+    ~AVLMemoryResource()
+    {
+        _destroyBlocks();
+    }
+
+    // Returns nullptr when no block has a large enough free segment and none can be added.
+    Byte *tryAllocate(size_t byteSize, size_t alignment = Block::Granularity)
+    {
+        Byte *ptr = nullptr;
+
+        _fromBlocks(byteSize, [&](Block &block) {
+            ptr = _allocate(block, byteSize, alignment);
+            return ptr != nullptr;
+        });
+
+        if (ptr == nullptr)
+        {
+            m_failures.fetch_add(1u, std::memory_order_relaxed);
+        }
+
+        return ptr;
+    }
+
+    // A non-zero byte count smaller than the allocation releases only its head and returns the
+    // pointer to the part that stays allocated.
+    // A whole allocation whose block another thread holds locked is queued on that block instead
+    // of waiting for it, and released along with others by the next thread that locks it.
+    Byte *release(Byte *ptr, size_t count = 0u)
+    {
+        const size_t slot = _slotOf(ptr);
+        Block &block = _block(slot);
+        std::unique_lock<std::mutex> lock(block.mutex, std::try_to_lock);
+
+        if (!lock.owns_lock())
+        {
+            if (count == 0u)
+            {
+                block.pushRemote(ptr);
+
+                // Queued releases may leave a block empty without anyone noticing.
+                if (m_maxBlocks != m_minBlocks)
+                {
+                    _maybeTrim();
+                }
+
+                return nullptr;
+            }
+
+            lock.lock();
+        }
+
+        _drainRemote(block);
+        Byte *rest = _deallocate(block, ptr, count);
+        const bool idle = _markIdle(block);
+        _publish(slot);
+        lock.unlock();
+
+        if (idle)
+        {
+            _maybeTrim();
+        }
+
+        return rest;
+    }
+
+    // Resizes the allocation at `ptr` to `byteSize` bytes without moving it. Returns false if the
+    // block has no room for it right behind the allocation.
+    bool tryResize(Byte *ptr, size_t byteSize)
+    {
+        const size_t slot = _slotOf(ptr);
+        Block &block = _block(slot);
+        std::lock_guard<std::mutex> lock(block.mutex);
+
+        _drainRemote(block);
+        const bool resized = block.resize(ptr, byteSize);
+        block.updatePeak();
+        _publish(slot);
+        return resized;
+    }
+
+    // Allocates `count` segments of `sizes[i] * elementSize` bytes each, locking every block it
+    // visits once. Returns how many leading entries of `out` were filled before space ran out.
+    template <typename T>
+    size_t tryAllocateBulk(const size_t *sizes, T **out, size_t count, size_t elementSize = 1u,
+                           size_t alignment = Block::Granularity)
+    {
+        size_t received = 0u;
+        size_t pending = (count != 0u) ? sizes[0] * elementSize : 0u;
+
+        _fromBlocks(pending, [&](Block &block) {
+            for (; received < count; ++received)
+            {
+                pending = sizes[received] * elementSize;
+                Byte *ptr = _allocate(block, pending, alignment);
+
+                if (ptr == nullptr)
+                {
+                    return false;
+                }
+                out[received] = reinterpret_cast<T *>(ptr);
+            }
+            return true;
+        });
+
+        if (received != count)
+        {
+            m_failures.fetch_add(1u, std::memory_order_relaxed);
+        }
+
+        return received;
+    }
+
+    // Releases whole allocations, taking each block's lock once. Sorts `ptrs` by address so
+    // neighbouring segments are merged in a single pass.
+    template <typename T>
+    void releaseBulk(T **ptrs, size_t count)
+    {
+        std::sort(ptrs, ptrs + count, std::less<T *>());
+        bool idle = false;
+
+        for (size_t first = 0u; first < count;)
+        {
+            const size_t slot = _slotOf(reinterpret_cast<Byte *>(ptrs[first]));
+            Block &block = _block(slot);
+            size_t last = first + 1u;
+
+            while (last < count && block.contains(reinterpret_cast<Byte *>(ptrs[last])))
+            {
+                ++last;
+            }
+
+            std::lock_guard<std::mutex> lock(block.mutex);
+            _drainRemote(block);
+            block.deallocateBulk(ptrs + first, last - first);
+            BlockCounters::add(block.counters.deallocations, uint64_t{last - first});
+            idle = _markIdle(block) || idle;
+            _publish(slot);
+            first = last;
+        }
+
+        if (idle)
+        {
+            _maybeTrim();
+        }
+    }
+
+    // Retires blocks that have been empty for the retire delay, newest first, while more than the
+    // initial number of blocks is in use. Runs on its own whenever a block turns empty, at most
+    // once per retire delay; call it to retire blocks of a resource that went quiet.
+    // Returns how many blocks were retired.
+    size_t trim()
+    {
+        std::lock_guard<std::mutex> growLock(m_growMutex);
+
+        const auto now = Clock::now();
+        m_nextTrim.store((now + m_retireDelay).time_since_epoch().count(), std::memory_order_relaxed);
+
+        size_t retired = 0u;
+
+        for (size_t i = _numBlocks(); i-- > 0u && m_activeBlocks.load(std::memory_order_relaxed) > m_minBlocks;)
+        {
+            Block &block = _block(i);
+            std::lock_guard<std::mutex> lock(block.mutex);
+
+            if (_drainRemote(block) != 0u)
+            {
+                _markIdle(block);
+                _publish(i);
+            }
+
+            if (!block.dormant && block.liveAllocations() == 0u && now - block.idleSince >= m_retireDelay)
+            {
+                block.reset();
+                block.dormant = true;
+                _publish(i);
+                m_activeBlocks.fetch_sub(1u, std::memory_order_relaxed);
+                ++retired;
+            }
+        }
+
+        return retired;
+    }
+
+    // Counters are read without locking; each block is locked briefly for its largest free segment.
+    ResourceStats stats()
+    {
+        ResourceStats stats;
+        stats.blocks.reserve(_numBlocks());
+        _drainRemoteFrees();
+
+        for (size_t i = 0u; i < _numBlocks(); ++i)
+        {
+            Block *block = &_block(i);
+            BlockStats blockStats = block->stats();
+            {
+                std::lock_guard<std::mutex> lock(block->mutex);
+                blockStats.largestFreeSegment = block->largestFreeSegment();
+                blockStats.dormant = block->dormant;
+            }
+
+            stats.activeBlocks += blockStats.dormant ? 0u : 1u;
+
+            stats.total.capacity += blockStats.capacity;
+            stats.total.usedBytes += blockStats.usedBytes;
+            stats.total.peakUsedBytes += blockStats.peakUsedBytes;
+            stats.total.freeBytes += blockStats.freeBytes;
+            stats.total.freeSegments += blockStats.freeSegments;
+            stats.total.largestFreeSegment = std::max(stats.total.largestFreeSegment, blockStats.largestFreeSegment);
+            stats.total.allocations += blockStats.allocations;
+            stats.total.deallocations += blockStats.deallocations;
+
+            for (size_t bin = 0u; bin < HistogramBins; ++bin)
+            {
+                stats.histogram[bin] += block->counters.histogram[bin].load(std::memory_order_relaxed);
+            }
+
+            stats.blocks.push_back(blockStats);
+        }
+
+        stats.failures = m_failures.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // Largest request a single allocate() call can currently satisfy, counting blocks it may add.
+    // Read from the block index without locking, so releases still queued on a block are not
+    // counted until the next operation on it.
+    size_t maxAllocation() const
+    {
+        const size_t maxSize = Block::roomIn(m_index.max());
+        const bool canGrow = m_activeBlocks.load(std::memory_order_relaxed) < m_maxBlocks;
+
+        return canGrow ? std::max(maxSize, Block::roomIn(Block::capacityFor(m_blockSize))) : maxSize;
+    }
+
+  protected:
+    void *do_allocate(size_t bytes, size_t alignment) override
+    {
+        Byte *ptr = tryAllocate(bytes, alignment);
+
+        if (ptr == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+
+        return ptr;
+    }
+
+    void do_deallocate(void *ptr, size_t /*bytes*/, size_t /*alignment*/) override
+    {
+        release(static_cast<Byte *>(ptr));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+  private:
+    template <size_t NumBlocks, size_t BlockSize, typename Tag>
+    friend class AVLArena;
+
+    size_t _numBlocks() const
+    {
+        return m_numBlocks.load(std::memory_order_acquire);
+    }
+
+    Block &_block(size_t index) const
+    {
+        return *m_blocks[index].load(std::memory_order_acquire);
+    }
+
+    void _destroyBlocks()
+    {
+        for (size_t i = 0u; i < _numBlocks(); ++i)
+        {
+            delete &_block(i);
+        }
+    }
+
+    // Block this thread tries first. Threads are spread over the blocks round-robin, so they
+    // only contend when their own block runs out of room.
+    static size_t _homeBlock(size_t numBlocks)
+    {
+        static std::atomic_size_t next{0u};
+        static thread_local const size_t ticket = next.fetch_add(1u, std::memory_order_relaxed);
+        return ticket % numBlocks;
+    }
+
+    // Offers the block in `slot` to `fill` unless it is retired, and publishes what is left of it.
+    template <typename Fill>
+    bool _fromBlock(size_t slot, Fill &&fill)
+    {
+        Block &block = _block(slot);
+        std::lock_guard<std::mutex> lock(block.mutex);
+
+        _drainRemote(block);
+        const bool filled = !block.dormant && fill(block);
+        _publish(slot);
+        return filled;
+    }
+
+    // Offers blocks to `fill` until it returns true, starting with the block the index picks for
+    // a request of `pending` bytes. When that one falls short, after a stale hint or on alignment
+    // padding, or when the index knows of none, the others are offered one by one, home block
+    // first: the index may lag behind queued releases and concurrent updates. Requests a slab
+    // may serve skip the index, since a partial slab needs no free segment.
+    template <typename Fill>
+    bool _scanBlocks(size_t pending, Fill &&fill)
+    {
+        const size_t numBlocks = _numBlocks();
+        const size_t home = _homeBlock(numBlocks);
+
+        if (!Block::Slabs::fits(pending))
+        {
+            const size_t slot = m_index.find(Block::segmentSize(pending), home);
+
+            if (slot != BlockIndex::npos && _fromBlock(slot, fill))
+            {
+                return true;
+            }
+        }
+
+        for (size_t i = 0u; i < numBlocks; ++i)
+        {
+            if (_fromBlock((home + i) % numBlocks, fill))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Like _scanBlocks(), but when every block falls short of a request of `pending` bytes, adds
+    // a block and scans again.
+    template <typename Fill>
+    bool _fromBlocks(const size_t &pending, Fill &&fill)
+    {
+        uint64_t generation;
+
+        do
+        {
+            generation = m_generation.load(std::memory_order_acquire);
+
+            if (_scanBlocks(pending, fill))
+            {
+                return true;
+            }
+        } while (_grow(generation, pending));
+
+        return false;
+    }
+
+    // Expects the block's mutex to be held. Returns how many queued releases were applied.
+    static size_t _drainRemote(Block &block)
+    {
+        const size_t drained = block.drainRemote();
+
+        if (drained != 0u)
+        {
+            BlockCounters::add(block.counters.deallocations, uint64_t{drained});
+        }
+
+        return drained;
+    }
+
+    // Applies the queued releases of every block that has some. Returns false if none had any.
+    bool _drainRemoteFrees()
+    {
+        bool drained = false;
+
+        for (size_t i = 0u; i < _numBlocks(); ++i)
+        {
+            Block &block = _block(i);
+
+            if (block.remoteFrees.load(std::memory_order_relaxed) == nullptr)
+            {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(block.mutex);
+
+            if (_drainRemote(block) != 0u)
+            {
+                _markIdle(block);
+                _publish(i);
+                drained = true;
+            }
+        }
+
+        return drained;
+    }
+
+    // Expects the block's mutex to be held.
+    void _publish(size_t slot)
+    {
+        Block &block = _block(slot);
+        m_index.update(slot, block.dormant ? 0u : block.largestFreeSegment());
+    }
+
+    // Brings back a retired block or adds a new one. Returns true without growing if blocks were
+    // added since `generation`, and false if the cap is reached or no block could hold `byteSize`.
+    bool _grow(uint64_t generation, size_t byteSize)
+    {
+        if (m_maxBlocks == m_minBlocks || byteSize > Block::roomIn(Block::capacityFor(m_blockSize)))
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> growLock(m_growMutex);
+
+        if (m_generation.load(std::memory_order_relaxed) != generation)
+        {
+            return true;
+        }
+
+        const size_t numBlocks = _numBlocks();
+        bool revived = false;
+
+        for (size_t i = 0u; i < numBlocks && !revived; ++i)
+        {
+            Block &block = _block(i);
+            std::lock_guard<std::mutex> lock(block.mutex);
+
+            revived = block.dormant;
+            block.dormant = false;
+            _publish(i);
+        }
+
+        if (!revived)
+        {
+            if (numBlocks == m_maxBlocks)
+            {
+                return false;
+            }
+
+            try
+            {
+                m_blocks[numBlocks].store(new Block(m_blockSize), std::memory_order_release);
+            }
+            catch (const std::bad_alloc &)
+            {
+                return false;
+            }
+
+            m_numBlocks.store(numBlocks + 1u, std::memory_order_release);
+
+            std::lock_guard<std::mutex> lock(_block(numBlocks).mutex);
+            _publish(numBlocks);
+        }
+
+        m_activeBlocks.fetch_add(1u, std::memory_order_relaxed);
+        m_generation.fetch_add(1u, std::memory_order_release);
+        return true;
+    }
+
+    // Expects the block's mutex to be held. Notes when a block that may be retired runs empty.
+    bool _markIdle(Block &block) const
+    {
+        if (m_maxBlocks == m_minBlocks || block.liveAllocations() != 0u)
+        {
+            return false;
+        }
+
+        block.idleSince = Clock::now();
+        return true;
+    }
+
+    void _maybeTrim()
+    {
+        if (Clock::now().time_since_epoch().count() >= m_nextTrim.load(std::memory_order_relaxed))
+        {
+            trim();
+        }
+    }
+
+    // Expects the block's mutex to be held.
+    static Byte *_allocate(Block &block, size_t byteSize, size_t alignment = Block::Granularity)
+    {
+        Byte *ptr = nullptr;
+
+        if (Block::Slabs::fits(byteSize) && alignment <= Block::Slabs::classAlignment(byteSize))
+        {
+            ptr = block.allocateSmall(byteSize);
+        }
+
+        if (ptr == nullptr)
+        {
+            ptr = block.allocate(byteSize, std::max(alignment, Block::Granularity));
+        }
+
+        if (ptr != nullptr)
+        {
+            block.countAllocation(byteSize);
+        }
+
+        return ptr;
+    }
+
+    // Pools never move, so the owning block is found without taking any lock.
+    size_t _slotOf(Byte *ptr) const
+    {
+        for (size_t i = 0u; i < _numBlocks(); ++i)
+        {
+            if (_block(i).contains(ptr))
+            {
+                return i;
+            }
+        }
+
+        throw std::bad_alloc();
+    }
+
+    // Expects the block's mutex to be held. A non-zero byte count smaller than the allocation
+    // releases only its head and returns the pointer to the part that stays allocated.
+    static Byte *_deallocate(Block &block, Byte *ptr, size_t count)
+    {
+        Byte *rest = block.ownsSmall(ptr) ? _deallocateSmall(block, ptr, count) : block.deallocate(ptr, count);
+
+        if (rest == nullptr)
+        {
+            BlockCounters::add(block.counters.deallocations, uint64_t{1u});
+        }
+
+        return rest;
+    }
+
+    // Slab objects record no requested size and are only ever released whole. Any count of the
+    // object's size class is taken for the whole request; a pointer into the object or a count
+    // of another class would trim it, which a slab cannot do, and throws std::bad_alloc.
+    static Byte *_deallocateSmall(Block &block, Byte *ptr, size_t count)
+    {
+        const size_t offset = ptr - block.pool.data();
+        const size_t objectSize = block.slabs.objectSize(block.pool.data(), offset);
+
+        if (block.slabs.roomAt(block.pool.data(), offset) != objectSize ||
+            (count != 0u && (count > objectSize || Block::Slabs::classSize(count) != objectSize)))
+        {
+            throw std::bad_alloc();
+        }
+
+        if (!block.deallocateSmall(offset))
+        {
+            throw std::bad_alloc();
+        }
+
+        return nullptr;
+    }
+
+    size_t _refill(size_t byteSize, Byte **out, size_t count)
+    {
+        size_t received = 0u;
+        const auto fill = [&](Block &block) {
+            while (received < count && (out[received] = _allocate(block, byteSize)) != nullptr)
+            {
+                ++received;
+            }
+            return received == count;
+        };
+
+        // A partial batch is enough; only an empty one is worth a new block.
+        if (!_scanBlocks(byteSize, fill) && received == 0u)
+        {
+            _fromBlocks(byteSize, fill);
+        }
+
+        if (received == 0u)
+        {
+            m_failures.fetch_add(1u, std::memory_order_relaxed);
+        }
+
+        return received;
+    }
+
+    // Slots for up to m_maxBlocks blocks; the first m_numBlocks are filled and never change.
+    std::unique_ptr<std::atomic<Block *>[]> m_blocks;
+    std::atomic<size_t> m_numBlocks{0u};
+    const size_t m_blockSize;
+    const size_t m_minBlocks;
+    const size_t m_maxBlocks;
+    const Clock::duration m_retireDelay;
+
+    // Serialises adding, reviving and retiring blocks. Taken before any block's mutex.
+    std::mutex m_growMutex;
+    BlockIndex m_index;
+    // Blocks not retired. Only changed under m_growMutex.
+    std::atomic<size_t> m_activeBlocks;
+    // Bumped whenever a block comes into use, so threads that failed together grow only once.
+    std::atomic<uint64_t> m_generation{0u};
+    std::atomic<Clock::rep> m_nextTrim{0};
+    std::atomic<uint64_t> m_failures{0u};
+};
+
+// The resource shared by every AVLAllocator with the same block sizes and traits, whatever its
+// value type, so rebound allocators of a container draw from one memory budget. Allocators that
+// should not share it use traits of their own. Also owns the per-thread cache in front of it.
+template <size_t NumBlocks, size_t BlockSize, typename Traits = DefaultAllocatorTraits>
+class AVLArena
+{
+  public:
+    using Resource = AVLMemoryResource<Traits>;
+    using Cache = ThreadCache<AVLArena>;
+    friend Cache;
+
+    // Never destroyed, so objects with static storage can still release into it at exit.
+    static Resource &shared()
+    {
+        static Resource *resource = new Resource(NumBlocks, BlockSize, Traits::MaxBlocks);
+        return *resource;
+    }
+
+  private:
+    static size_t _refillCache(size_t byteSize, Byte **out, size_t count)
+    {
+        return shared()._refill(byteSize, out, count);
+    }
+
+    static void _flushCache(Byte **ptrs, size_t count)
+    {
+        shared().releaseBulk(ptrs, count);
+    }
+};
+
+} // namespace Utility
+} // namespace Yaro
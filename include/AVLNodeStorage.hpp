@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "NodeArena.hpp"
+
+namespace Yaro
+{
+namespace Utility
+{
+
+template <typename KeyType>
+struct AVLNode
+{
+    KeyType key;
+    size_t count;
+    uint8_t height;
+
+    AVLNode *left;
+    AVLNode *right;
+};
+
+// What a node keeps about its subtree besides its height. Nodes derive from their summary, so
+// keeping none costs no space.
+template <typename KeyType>
+struct NoSummary
+{
+    // Recomputes the summary from the node's key and its children's summaries, null where a
+    // child is missing. Returns whether the summary changed.
+    bool refresh(const KeyType &, const NoSummary *, const NoSummary *)
+    {
+        return false;
+    }
+};
+
+template <typename KeyType, typename Summary = NoSummary<KeyType>>
+struct CompactAVLNode : Summary
+{
+    KeyType key;
+    uint32_t left;
+    uint32_t right;
+    uint32_t count;
+    uint8_t height;
+};
+
+// Node storage policies for AVLTree. A storage hands out links to nodes, resolves them with
+// operator[] and guarantees that create() after reserve() leaves existing nodes in place.
+// refresh() brings a node's subtree summary up to date after its children changed.
+
+// Pointer-linked nodes drawn from a chunked arena.
+template <typename KeyType>
+class PooledNodes
+{
+  public:
+    using Node = AVLNode<KeyType>;
+    using Link = Node *;
+
+    static constexpr Link Null = nullptr;
+
+    Node &operator[](Link link)
+    {
+        return *link;
+    }
+
+    const Node &operator[](Link link) const
+    {
+        return *link;
+    }
+
+    Link create(const KeyType &key, size_t count, uint8_t height, Link left, Link right)
+    {
+        return m_arena.create(key, count, height, left, right);
+    }
+
+    void destroy(Link link)
+    {
+        m_arena.destroy(link);
+    }
+
+    bool refresh(Link)
+    {
+        return false;
+    }
+
+    void reserve()
+    {
+    }
+
+    void clear()
+    {
+        m_arena.clear();
+    }
+
+    size_t memoryUsage() const
+    {
+        return m_arena.capacity() * sizeof(Node);
+    }
+
+  private:
+    NodeArena<Node> m_arena;
+};
+
+// Nodes kept in one contiguous vector and linked by 32-bit indices. Released nodes are chained
+// through their left link and reused before the vector grows. Every node keeps a `Summary` of
+// its subtree, see NoSummary.
+template <typename KeyType, template <typename> class Summary>
+class SummarizedCompactNodes
+{
+  public:
+    using Node = CompactAVLNode<KeyType, Summary<KeyType>>;
+    using Link = uint32_t;
+
+    static constexpr Link Null = std::numeric_limits<uint32_t>::max();
+
+    SummarizedCompactNodes() = default;
+
+    SummarizedCompactNodes(const SummarizedCompactNodes &other) = delete;
+    SummarizedCompactNodes &operator=(const SummarizedCompactNodes &other) = delete;
+
+    SummarizedCompactNodes(SummarizedCompactNodes &&rr)
+        : m_nodes{std::move(rr.m_nodes)}, m_free{rr.m_free}
+    {
+        rr.clear();
+    }
+
+    SummarizedCompactNodes &operator=(SummarizedCompactNodes &&rr)
+    {
+        m_nodes = std::move(rr.m_nodes);
+        m_free = rr.m_free;
+
+        rr.clear();
+        return *this;
+    }
+
+    Node &operator[](Link link)
+    {
+        return m_nodes[link];
+    }
+
+    const Node &operator[](Link link) const
+    {
+        return m_nodes[link];
+    }
+
+    Link create(const KeyType &key, size_t count, uint8_t height, Link left, Link right)
+    {
+        const Node node{{}, key, left, right, static_cast<uint32_t>(count), height};
+        Link link;
+
+        if (m_free != Null)
+        {
+            link = m_free;
+            m_free = m_nodes[link].left;
+            m_nodes[link] = node;
+        }
+        else
+        {
+            m_nodes.push_back(node);
+            link = static_cast<Link>(m_nodes.size() - 1u);
+        }
+
+        refresh(link);
+        return link;
+    }
+
+    void destroy(Link link)
+    {
+        m_nodes[link].left = m_free;
+        m_free = link;
+    }
+
+    bool refresh(Link link)
+    {
+        Node &node = m_nodes[link];
+        return node.refresh(node.key, _summary(node.left), _summary(node.right));
+    }
+
+    // Makes room for one more node, so references into the vector survive the next create().
+    void reserve()
+    {
+        if (m_free == Null && m_nodes.size() == m_nodes.capacity())
+        {
+            m_nodes.reserve(std::max<size_t>(m_nodes.capacity() * 2u, 64u));
+        }
+    }
+
+    void clear()
+    {
+        m_nodes.clear();
+        m_nodes.shrink_to_fit();
+        m_free = Null;
+    }
+
+    size_t memoryUsage() const
+    {
+        return m_nodes.capacity() * sizeof(Node);
+    }
+
+  private:
+    const Summary<KeyType> *_summary(Link link) const
+    {
+        return (link == Null) ? nullptr : &m_nodes[link];
+    }
+
+    std::vector<Node> m_nodes;
+    Link m_free = Null;
+};
+
+template <typename KeyType>
+using CompactNodes = SummarizedCompactNodes<KeyType, NoSummary>;
+
+} // namespace Utility
+} // namespace Yaro
@@ -10,7 +10,7 @@
 #include <unordered_map>
 #include <vector>
 
-#include "Shared.hpp"
+#include "AVLNodeStorage.hpp"
 #include "debug.hpp"
 
 namespace Yaro
@@ -97,54 +97,64 @@ struct KeyTypeTraits
         return a - b;
     }
 };
-template <typename KeyType>
-struct AVLNode : public Shared<AVLNode<KeyType>>
-{
-    static AVLNode *create(const KeyType &k, uint16_t h, uint32_t c, AVLNode *l, AVLNode *r);
-    static AVLNode *create(const AVLNode &node);
-
-    KeyType key;
-    size_t count;
-    uint8_t height;
 
-    typename Shared<AVLNode>::Ptr left;
-    typename Shared<AVLNode>::Ptr right;
-};
-
-template <typename KeyType>
+// `Storage` decides how nodes are laid out and linked, see AVLNodeStorage.hpp.
+template <typename KeyType, template <typename> class Storage = PooledNodes>
 class AVLTree
 {
   public:
-    using Node = AVLNode<KeyType>;
+    using NodeStorage = Storage<KeyType>;
+    using Node = typename NodeStorage::Node;
+    using Link = typename NodeStorage::Link;
+
+    static constexpr Link Null = NodeStorage::Null;
 
   private:
-    const typename Node::Ptr _find(typename Node::Ptr pNode, const KeyType &key) const;
 
-    bool _pop(typename Node::Ptr &pNode, const KeyType &key);
+    // An AVL tree of 2^64 nodes is less than 94 levels high.
+    static constexpr size_t MaxHeight = 96u;
+
+    // Links followed from the root during a descent, deepest last.
+    using Path = std::array<Link *, MaxHeight>;
+
+    Link _find(Link pNode, const KeyType &key) const;
 
-    const KeyType *_insert(typename Node::Ptr &pNode, const KeyType &key);
+    bool _pop(const KeyType &key);
 
-    const KeyType *_findMax(typename Node::Ptr &pNode);
+    const KeyType *_insert(const KeyType &key);
 
-    void _leftRotation(typename Node::Ptr &pNode);
+    // Levels at `refreshFrom` or deeper are rebalanced even when they settle.
+    void _rebalance(Path &path, size_t depth, size_t refreshFrom = MaxHeight);
 
-    void _rightRotation(typename Node::Ptr &pNode);
+    void _leftRotation(Link &pNode);
 
-    void _balance(typename Node::Ptr &pNode, const KeyType &key);
+    void _rightRotation(Link &pNode);
 
-    const size_t _count(const typename Node::Ptr &pNode, const KeyType &key) const;
+    // Returns whether the summary of the subtree changed.
+    bool _balance(Link &pNode);
 
-    const int32_t _difference(const typename Node::Ptr &pNode) const;
+    const size_t _count(Link pNode, const KeyType &key) const;
 
-    const int32_t _height(const typename Node::Ptr &pNode) const;
+    const int32_t _difference(Link pNode) const;
 
-    typename Node::Ptr &_minKeyNode(typename Node::Ptr &pNode);
+    const int32_t _height(Link pNode) const;
 
-    typename Node::Ptr &_maxKeyNode(typename Node::Ptr &pNode);
+    Link &_minKeyNode(Link &pNode);
 
-    bool _findClosest(typename Node::Ptr pNode, const KeyType &key, KeyType &outKey,
+    Link &_maxKeyNode(Link &pNode);
+
+    bool _findClosest(Link pNode, const KeyType &key, KeyType &outKey,
                       KeyType (*calculateDelta)(const KeyType &l, const KeyType &r));
 
+    // Nearest key for which `inRange(key, bound)` holds: the smallest one if `upward`, else the
+    // largest. Unlike _findClosest it compares whole keys, so ties in the delta cannot mislead it.
+    bool _findBound(const KeyType &bound, KeyType &outKey, bool (*inRange)(const KeyType &l, const KeyType &r),
+                    bool upward) const;
+
+    Link _copy(const NodeStorage &nodes, Link pNode);
+
+    void _destroy(Link pNode);
+
   public:
     AVLTree() = default;
 
@@ -158,6 +168,8 @@ class AVLTree
 
     AVLTree &operator=(AVLTree &&rr);
 
+    ~AVLTree();
+
     bool operator==(const AVLTree &other) const;
 
     bool operator!=(const AVLTree &other) const;
@@ -190,10 +202,30 @@ class AVLTree
 
     bool findClosestLesser(const KeyType &key, KeyType &outKey);
 
+    // Smallest key not less than `key` for which `matches` holds, visiting keys in order.
+    template <typename Predicate>
+    bool findFirstGreaterEqual(const KeyType &key, Predicate matches, KeyType &outKey);
+
     void print(uint8_t topOffset = 4u) const;
 
+    // Bytes held by node storage, including nodes kept for reuse.
+    size_t memoryUsage() const;
+
+    // Read-only access to the nodes, for searches guided by the storage's subtree summaries.
+    Link root() const
+    {
+        return m_root;
+    }
+
+    const Node &node(Link link) const
+    {
+        return m_nodes[link];
+    }
+
   private:
-    typename Node::Ptr m_root = nullptr;
+    NodeStorage m_nodes;
+
+    Link m_root = Null;
 
     size_t m_size = 0u;
 };
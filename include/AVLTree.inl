@@ -1,204 +1,204 @@
 #pragma once
 
-template <typename KeyType>
-AVLNode<KeyType> *AVLNode<KeyType>::create(const KeyType &k, uint16_t h, uint32_t c, AVLNode *l, AVLNode *r)
+template <typename KeyType, template <typename> class Storage>
+const KeyType *AVLTree<KeyType, Storage>::_insert(const KeyType &key)
 {
-    AVLNode *p = new AVLNode;
+    Path path;
+    size_t depth = 0u;
+    Link *pLink = &m_root;
 
-    p->key = k;
-    p->height = h;
-    p->count = c;
-    p->left.reset(l);
-    p->right.reset(r);
-
-    return p;
-}
-
-template <typename KeyType>
-AVLNode<KeyType> *AVLNode<KeyType>::create(const AVLNode &node)
-{
-    AVLNode *p = new AVLNode;
-
-    p->key = node.key;
-    p->height = node.height;
-    p->count = node.count;
-
-    if (node.left != nullptr)
-    {
-        p->left.reset(create(*node.left));
-    }
-    else
+    while (*pLink != Null)
     {
-        p->left = nullptr;
-    }
+        Node &node = m_nodes[*pLink];
 
-    if (node.right != nullptr)
-    {
-        p->right.reset(create(*node.right));
-    }
-    else
-    {
-        p->right = nullptr;
+        if (key < node.key)
+        {
+            path[depth++] = pLink;
+            pLink = &node.left;
+        }
+        else if (key > node.key)
+        {
+            path[depth++] = pLink;
+            pLink = &node.right;
+        }
+        else
+        {
+            ++node.count;
+            return &node.key;
+        }
     }
 
-    return p;
+    *pLink = m_nodes.create(key, size_t{1u}, uint8_t{1u}, Null, Null);
+    const KeyType *res = &(m_nodes[*pLink].key);
+
+    _rebalance(path, depth);
+    return res;
 }
 
-template <typename KeyType>
-const KeyType *AVLTree<KeyType>::_insert(typename Node::Ptr &pNode, const KeyType &key)
+template <typename KeyType, template <typename> class Storage>
+typename AVLTree<KeyType, Storage>::Link &AVLTree<KeyType, Storage>::_minKeyNode(Link &pNode)
 {
-    const KeyType *res = nullptr;
+    Link *pLink = &pNode;
 
-    if (pNode == nullptr)
-    {
-        pNode.reset(Node::create(key, 1u, 1u, nullptr, nullptr));
-        return &(pNode->key);
-    }
-    else if (key < pNode->key)
-    {
-        res = _insert(pNode->left, key);
-    }
-    else if (key > pNode->key)
+    while (m_nodes[*pLink].left != Null)
     {
-        res = _insert(pNode->right, key);
-    }
-    else
-    {
-        pNode->count++;
-        res = &(pNode->key);
+        pLink = &m_nodes[*pLink].left;
     }
 
-    _balance(pNode, key);
-    return res;
+    return *pLink;
 }
 
-template <typename KeyType>
-typename AVLTree<KeyType>::Node::Ptr &AVLTree<KeyType>::_minKeyNode(typename Node::Ptr &pNode)
+template <typename KeyType, template <typename> class Storage>
+typename AVLTree<KeyType, Storage>::Link &AVLTree<KeyType, Storage>::_maxKeyNode(Link &pNode)
 {
-    if (pNode->left != nullptr)
+    Link *pLink = &pNode;
+
+    while (m_nodes[*pLink].right != Null)
     {
-        return _minKeyNode(pNode->left);
+        pLink = &m_nodes[*pLink].right;
     }
 
-    return pNode;
+    return *pLink;
 }
 
-template <typename KeyType>
-typename AVLTree<KeyType>::Node::Ptr &AVLTree<KeyType>::_maxKeyNode(typename Node::Ptr &pNode)
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::_pop(const KeyType &key)
 {
-    if (pNode->right != nullptr)
+    Path path;
+    size_t depth = 0u;
+    Link *pLink = &m_root;
+
+    while (*pLink != Null && m_nodes[*pLink].key != key)
     {
-        return _maxKeyNode(pNode->right);
+        path[depth++] = pLink;
+        pLink = (m_nodes[*pLink].key > key) ? &m_nodes[*pLink].left : &m_nodes[*pLink].right;
     }
 
-    return pNode;
-}
-
-template <typename KeyType>
-bool AVLTree<KeyType>::_pop(typename Node::Ptr &pNode, const KeyType &key)
-{
-    bool countEq1 = false;
-
-    if (pNode == nullptr)
+    if (*pLink == Null)
     {
         return false;
     }
-    else if (pNode->key > key)
+
+    Node &node = m_nodes[*pLink];
+
+    if (node.count != 1u)
     {
-        return _pop(pNode->left, key);
+        --node.count;
+        return true;
     }
-    else if (pNode->key < key)
+
+    const Link removed = *pLink;
+    size_t refreshFrom = MaxHeight;
+
+    if (node.left == Null || node.right == Null)
     {
-        return _pop(pNode->right, key);
+        *pLink = (node.left != Null) ? node.left : node.right;
     }
     else
     {
-        countEq1 = pNode->count == 1u;
+        // The in-order successor is unlinked and takes the removed node's place, so it is
+        // found once and its key is never copied.
+        const size_t removedDepth = depth;
+        path[depth++] = pLink;
 
-        if (!countEq1)
+        Link *pSuccessor = &node.right;
+        while (m_nodes[*pSuccessor].left != Null)
         {
-            --pNode->count;
-            return true;
+            path[depth++] = pSuccessor;
+            pSuccessor = &m_nodes[*pSuccessor].left;
         }
 
-        if (pNode->left != nullptr && pNode->right == nullptr)
-        {
-            pNode = pNode->left;
-        }
-        else if (pNode->left == nullptr && pNode->right != nullptr)
-        {
-            pNode = pNode->right;
-        }
-        else if (pNode->left != nullptr && pNode->right != nullptr)
-        {
-            typename Node::Ptr &minKeyNode = _minKeyNode(pNode->right);
-            pNode->key = minKeyNode->key;
-            _pop(pNode->right, minKeyNode->key);
-        }
-        else
+        const Link successor = *pSuccessor;
+        *pSuccessor = m_nodes[successor].right;
+
+        m_nodes[successor].left = node.left;
+        m_nodes[successor].right = node.right;
+        m_nodes[successor].height = node.height;
+        *pLink = successor;
+
+        if (depth > removedDepth + 1u)
         {
-            pNode = nullptr;
+            path[removedDepth + 1u] = &m_nodes[successor].right;
         }
-    }
 
-    if (countEq1 && pNode != nullptr)
-    {
-        _balance(pNode, key);
+        // The successor's summary still describes the subtree it left.
+        refreshFrom = removedDepth;
     }
 
+    m_nodes.destroy(removed);
+    _rebalance(path, depth, refreshFrom);
+
     return true;
 }
 
-template <typename KeyType>
-const typename AVLTree<KeyType>::Node::Ptr AVLTree<KeyType>::_find(typename Node::Ptr pNode, const KeyType &key) const
+template <typename KeyType, template <typename> class Storage>
+void AVLTree<KeyType, Storage>::_rebalance(Path &path, size_t depth, size_t refreshFrom)
 {
-    while (pNode != nullptr)
+    // Ancestors above a subtree whose height and summary did not change keep theirs and their balance.
+    while (depth != 0u)
     {
-        if (pNode->key == key)
+        Link &pNode = *path[--depth];
+        const uint8_t height = m_nodes[pNode].height;
+
+        const bool changed = _balance(pNode);
+
+        if (depth < refreshFrom && !changed && m_nodes[pNode].height == height)
+        {
+            break;
+        }
+    }
+}
+
+template <typename KeyType, template <typename> class Storage>
+typename AVLTree<KeyType, Storage>::Link AVLTree<KeyType, Storage>::_find(Link pNode, const KeyType &key) const
+{
+    while (pNode != Null)
+    {
+        if (m_nodes[pNode].key == key)
         {
             return pNode;
         }
-        else if (pNode->key < key)
+        else if (m_nodes[pNode].key < key)
         {
-            pNode = pNode->right;
+            pNode = m_nodes[pNode].right;
         }
         else
         {
-            pNode = pNode->left;
+            pNode = m_nodes[pNode].left;
         }
     }
 
-    return nullptr;
+    return Null;
 }
 
-template <typename KeyType>
-bool AVLTree<KeyType>::_findClosest(typename Node::Ptr pNode, const KeyType &key, KeyType &outKey,
-                                    KeyType (*calculateDelta)(const KeyType &l, const KeyType &r))
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::_findClosest(Link pNode, const KeyType &key, KeyType &outKey,
+                                             KeyType (*calculateDelta)(const KeyType &l, const KeyType &r))
 {
-    if (pNode == nullptr)
+    if (pNode == Null)
     {
         return false;
     }
 
     KeyType minDelta = KeyTypeTraits<KeyType>::max();
 
-    while (pNode != nullptr)
+    while (pNode != Null)
     {
-        KeyType delta = calculateDelta(pNode->key, key);
+        KeyType delta = calculateDelta(m_nodes[pNode].key, key);
 
         if (KeyTypeTraits<KeyType>::greater(minDelta, delta))
         {
             minDelta = delta;
-            outKey = pNode->key;
+            outKey = m_nodes[pNode].key;
         }
 
-        if (KeyTypeTraits<KeyType>::less(pNode->key, key))
+        if (KeyTypeTraits<KeyType>::less(m_nodes[pNode].key, key))
         {
-            pNode = pNode->right;
+            pNode = m_nodes[pNode].right;
         }
-        else if (KeyTypeTraits<KeyType>::greater(pNode->key, key))
+        else if (KeyTypeTraits<KeyType>::greater(m_nodes[pNode].key, key))
         {
-            pNode = pNode->left;
+            pNode = m_nodes[pNode].left;
         }
         else
         {
@@ -206,50 +206,30 @@ bool AVLTree<KeyType>::_findClosest(typename Node::Ptr pNode, const KeyType &key
         }
     }
 
-    if (pNode != nullptr)
+    if (pNode != Null)
     {
-        bool iterate = true;
-        bool left = false;
+        // The key itself is in the tree, so the remaining candidates are its in-order neighbours.
+        KeyType delta;
 
-        while (iterate)
+        if (m_nodes[pNode].left != Null)
         {
-            iterate = false;
-            left = false;
+            delta = calculateDelta(m_nodes[_maxKeyNode(m_nodes[pNode].left)].key, key);
 
-            KeyType delta;
-
-            if (pNode->left != nullptr)
+            if (KeyTypeTraits<KeyType>::greater(minDelta, delta))
             {
-                delta = calculateDelta(pNode->left->key, key);
-
-                if (KeyTypeTraits<KeyType>::greater(minDelta, delta))
-                {
-                    minDelta = delta;
-                    outKey = pNode->left->key;
-                    left = true;
-                    iterate = true;
-                }
+                minDelta = delta;
+                outKey = m_nodes[_maxKeyNode(m_nodes[pNode].left)].key;
             }
+        }
 
-            if (pNode->right != nullptr)
-            {
-                delta = calculateDelta(pNode->right->key, key);
-
-                if (KeyTypeTraits<KeyType>::greater(minDelta, delta))
-                {
-                    minDelta = delta;
-                    outKey = pNode->left->key;
-                    iterate = true;
-                }
-            }
+        if (m_nodes[pNode].right != Null)
+        {
+            delta = calculateDelta(m_nodes[_minKeyNode(m_nodes[pNode].right)].key, key);
 
-            if (left)
-            {
-                pNode = pNode->left;
-            }
-            else
+            if (KeyTypeTraits<KeyType>::greater(minDelta, delta))
             {
-                pNode = pNode->right;
+                minDelta = delta;
+                outKey = m_nodes[_minKeyNode(m_nodes[pNode].right)].key;
             }
         }
     }
@@ -257,99 +237,125 @@ bool AVLTree<KeyType>::_findClosest(typename Node::Ptr pNode, const KeyType &key
     return KeyTypeTraits<KeyType>::notEqual(minDelta, KeyTypeTraits<KeyType>::max());
 }
 
-template <typename KeyType>
-void AVLTree<KeyType>::_leftRotation(typename Node::Ptr &pNode)
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::_findBound(const KeyType &bound, KeyType &outKey,
+                                           bool (*inRange)(const KeyType &l, const KeyType &r), bool upward) const
+{
+    bool found = false;
+    Link pNode = m_root;
+
+    while (pNode != Null)
+    {
+        const Node &node = m_nodes[pNode];
+
+        if (inRange(node.key, bound))
+        {
+            outKey = node.key;
+            found = true;
+            pNode = upward ? node.left : node.right;
+        }
+        else
+        {
+            pNode = upward ? node.right : node.left;
+        }
+    }
+
+    return found;
+}
+
+template <typename KeyType, template <typename> class Storage>
+void AVLTree<KeyType, Storage>::_leftRotation(Link &pNode)
 {
-    typename Node::Ptr &x = pNode;
-    typename Node::Ptr y = x->right;
-    typename Node::Ptr t = y->left;
+    Link &x = pNode;
+    Link y = m_nodes[x].right;
+    Link t = m_nodes[y].left;
 
-    y->left = x;
-    x->right = t;
+    m_nodes[y].left = x;
+    m_nodes[x].right = t;
 
-    x->height = std::max(_height(x->left), _height(x->right)) + 1u;
-    y->height = std::max(_height(y->left), _height(y->right)) + 1u;
+    m_nodes[x].height = std::max(_height(m_nodes[x].left), _height(m_nodes[x].right)) + 1u;
+    m_nodes[y].height = std::max(_height(m_nodes[y].left), _height(m_nodes[y].right)) + 1u;
+    m_nodes.refresh(x);
+    m_nodes.refresh(y);
 
     x = y;
 }
-template <typename KeyType>
-void AVLTree<KeyType>::_rightRotation(typename Node::Ptr &pNode)
+template <typename KeyType, template <typename> class Storage>
+void AVLTree<KeyType, Storage>::_rightRotation(Link &pNode)
 {
-    typename Node::Ptr &x = pNode;
-    typename Node::Ptr y = x->left;
-    typename Node::Ptr t = y->right;
+    Link &x = pNode;
+    Link y = m_nodes[x].left;
+    Link t = m_nodes[y].right;
 
-    y->right = x;
-    x->left = t;
+    m_nodes[y].right = x;
+    m_nodes[x].left = t;
 
-    x->height = std::max(_height(x->left), _height(x->right)) + 1u;
-    y->height = std::max(_height(y->left), _height(y->right)) + 1u;
+    m_nodes[x].height = std::max(_height(m_nodes[x].left), _height(m_nodes[x].right)) + 1u;
+    m_nodes[y].height = std::max(_height(m_nodes[y].left), _height(m_nodes[y].right)) + 1u;
+    m_nodes.refresh(x);
+    m_nodes.refresh(y);
 
     x = y;
 }
 
-template <typename KeyType>
-void AVLTree<KeyType>::_balance(typename Node::Ptr &pNode, const KeyType &key)
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::_balance(Link &pNode)
 {
-    pNode->height = std::max(_height(pNode->left), _height(pNode->right)) + 1u;
+    m_nodes[pNode].height = std::max(_height(m_nodes[pNode].left), _height(m_nodes[pNode].right)) + 1u;
+    const bool changed = m_nodes.refresh(pNode);
 
     const int32_t diff = _difference(pNode);
 
+    // Rotations follow the children's balance, which holds after removals as well as insertions.
     if (diff > 1)
     {
-        if (KeyTypeTraits<KeyType>::less(key, pNode->left->key))
+        if (_difference(m_nodes[pNode].left) < 0)
         {
-            _rightRotation(pNode);
-        }
-        else if (KeyTypeTraits<KeyType>::greater(key, pNode->left->key))
-        {
-            _leftRotation(pNode->left);
-            _rightRotation(pNode);
+            _leftRotation(m_nodes[pNode].left);
         }
+        _rightRotation(pNode);
     }
     if (diff < -1)
     {
-        if (KeyTypeTraits<KeyType>::greater(key, pNode->right->key))
-        {
-            _leftRotation(pNode);
-        }
-        else if (KeyTypeTraits<KeyType>::less(key, pNode->right->key))
+        if (_difference(m_nodes[pNode].right) > 0)
         {
-            _rightRotation(pNode->right);
-            _leftRotation(pNode);
+            _rightRotation(m_nodes[pNode].right);
         }
+        _leftRotation(pNode);
     }
+
+    return changed;
 }
 
-template <typename KeyType>
-const size_t AVLTree<KeyType>::_count(const typename Node::Ptr &pNode, const KeyType &key) const
+template <typename KeyType, template <typename> class Storage>
+const size_t AVLTree<KeyType, Storage>::_count(Link pNode, const KeyType &key) const
 {
     const auto node = _find(pNode, key);
-    return (node == nullptr) ? 0u : node->count;
+    return (node == Null) ? 0u : m_nodes[node].count;
 }
 
-template <typename KeyType>
-const int32_t AVLTree<KeyType>::_height(const typename Node::Ptr &pNode) const
+template <typename KeyType, template <typename> class Storage>
+const int32_t AVLTree<KeyType, Storage>::_height(Link pNode) const
 {
-    if (pNode != nullptr)
+    if (pNode != Null)
     {
-        return pNode->height;
+        return m_nodes[pNode].height;
     }
 
     return 0;
 }
 
-template <typename KeyType>
-const int32_t AVLTree<KeyType>::_difference(const typename Node::Ptr &pNode) const
+template <typename KeyType, template <typename> class Storage>
+const int32_t AVLTree<KeyType, Storage>::_difference(Link pNode) const
 {
-    const int32_t leftHeight = _height(pNode->left);
-    const int32_t rightHeight = _height(pNode->right);
+    const int32_t leftHeight = _height(m_nodes[pNode].left);
+    const int32_t rightHeight = _height(m_nodes[pNode].right);
 
     return leftHeight - rightHeight;
 }
 
-template <typename KeyType>
-void AVLTree<KeyType>::print(uint8_t topOffset) const
+template <typename KeyType, template <typename> class Storage>
+void AVLTree<KeyType, Storage>::print(uint8_t topOffset) const
 {
     const uint32_t height = _height(m_root);
 
@@ -359,19 +365,19 @@ void AVLTree<KeyType>::print(uint8_t topOffset) const
     }
     else if (height == 1u)
     {
-        std::cout << m_root->key << std::endl;
+        std::cout << m_nodes[m_root].key << std::endl;
     }
 
-    std::function<uint32_t(const typename Node::Ptr &)> findLongestNumber =
-        [&findLongestNumber](const typename Node::Ptr &pNode) -> uint32_t {
-        if (pNode == nullptr)
+    std::function<uint32_t(Link)> findLongestNumber =
+        [this, &findLongestNumber](Link pNode) -> uint32_t {
+        if (pNode == Null)
         {
             return 0u;
         }
 
-        const uint32_t maxChild = std::max(findLongestNumber(pNode->left), findLongestNumber(pNode->right));
+        const uint32_t maxChild = std::max(findLongestNumber(m_nodes[pNode].left), findLongestNumber(m_nodes[pNode].right));
 
-        return std::max(maxChild, static_cast<uint32_t>(std::to_string(pNode->key).length()));
+        return std::max(maxChild, static_cast<uint32_t>(std::to_string(m_nodes[pNode].key).length()));
     };
 
     const uint32_t maxLowerNodes = (1u << (height - 1u));
@@ -379,14 +385,14 @@ void AVLTree<KeyType>::print(uint8_t topOffset) const
     const uint32_t offset = findLongestNumber(m_root);
     const uint32_t width = maxLowerNodes * (offset + 4u) + 1;
     const uint32_t buffWidth = width + offset * 2u;
-    const uint32_t buffHeight = m_root->height * topOffset + 1u;
+    const uint32_t buffHeight = m_nodes[m_root].height * topOffset + 1u;
 
     std::vector<std::string> buff(buffHeight, std::string(buffWidth, ' '));
 
-    const std::function<void(const typename Node::Ptr &, uint32_t, uint32_t, uint32_t)> printRecursive =
-        [&buff, &width, &offset, &printRecursive, &topOffset](const typename Node::Ptr &pNode, uint32_t leftCoord,
-                                                              uint32_t topCoord, uint32_t dist) -> void {
-        if (pNode == nullptr)
+    const std::function<void(Link, uint32_t, uint32_t, uint32_t)> printRecursive =
+        [this, &buff, &width, &offset, &printRecursive, &topOffset](Link pNode, uint32_t leftCoord,
+                                                                    uint32_t topCoord, uint32_t dist) -> void {
+        if (pNode == Null)
         {
             return;
         }
@@ -394,7 +400,7 @@ void AVLTree<KeyType>::print(uint8_t topOffset) const
         const uint32_t x = leftCoord;
         const uint32_t y = topCoord;
 
-        const std::string numStr = std::to_string(pNode->key);
+        const std::string numStr = std::to_string(m_nodes[pNode].key);
 
         const uint32_t halfLength = numStr.length() / 2u;
 
@@ -403,8 +409,8 @@ void AVLTree<KeyType>::print(uint8_t topOffset) const
             buff[y][offset + x + i - halfLength] = numStr[i];
         }
 
-        printRecursive(pNode->left, leftCoord - (dist / 2), topCoord + topOffset, dist / 2);
-        printRecursive(pNode->right, leftCoord + (dist / 2), topCoord + topOffset, dist / 2);
+        printRecursive(m_nodes[pNode].left, leftCoord - (dist / 2), topCoord + topOffset, dist / 2);
+        printRecursive(m_nodes[pNode].right, leftCoord + (dist / 2), topCoord + topOffset, dist / 2);
     };
 
     printRecursive(m_root, width / 2u, 0u, width / 2u);
@@ -415,43 +421,90 @@ void AVLTree<KeyType>::print(uint8_t topOffset) const
     }
 }
 
-template <typename KeyType>
-AVLTree<KeyType>::AVLTree(const KeyType &key)
+template <typename KeyType, template <typename> class Storage>
+typename AVLTree<KeyType, Storage>::Link AVLTree<KeyType, Storage>::_copy(const NodeStorage &nodes, Link pNode)
+{
+    if (pNode == Null)
+    {
+        return Null;
+    }
+
+    const Link left = _copy(nodes, nodes[pNode].left);
+    const Link right = _copy(nodes, nodes[pNode].right);
+
+    return m_nodes.create(nodes[pNode].key, nodes[pNode].count, nodes[pNode].height, left, right);
+}
+
+template <typename KeyType, template <typename> class Storage>
+void AVLTree<KeyType, Storage>::_destroy(Link pNode)
+{
+    if (pNode == Null)
+    {
+        return;
+    }
+
+    _destroy(m_nodes[pNode].left);
+    _destroy(m_nodes[pNode].right);
+    m_nodes.destroy(pNode);
+}
+
+template <typename KeyType, template <typename> class Storage>
+AVLTree<KeyType, Storage>::AVLTree(const KeyType &key)
 {
     ++m_size;
-    m_root.reset(Node::create(key, 1u, 1u, nullptr, nullptr));
+    m_root = m_nodes.create(key, size_t{1u}, uint8_t{1u}, Null, Null);
 }
 
-template <typename KeyType>
-AVLTree<KeyType>::AVLTree(const AVLTree &other)
-    : m_root{((other.m_root != nullptr) ? Node::create(*other.m_root) : nullptr)}, m_size{other.m_size}
+template <typename KeyType, template <typename> class Storage>
+AVLTree<KeyType, Storage>::AVLTree(const AVLTree &other)
+    : m_root{_copy(other.m_nodes, other.m_root)}, m_size{other.m_size}
 {
 }
 
-template <typename KeyType>
-AVLTree<KeyType> &AVLTree<KeyType>::operator=(const AVLTree &other)
+template <typename KeyType, template <typename> class Storage>
+AVLTree<KeyType, Storage> &AVLTree<KeyType, Storage>::operator=(const AVLTree &other)
 {
-    m_root.reset(((other.m_root != nullptr) ? Node::create(*other.m_root) : nullptr));
-    m_size = other.m_size;
+    if (this != &other)
+    {
+        clear();
+        m_root = _copy(other.m_nodes, other.m_root);
+        m_size = other.m_size;
+    }
     return *this;
 }
 
-template <typename KeyType>
-AVLTree<KeyType>::AVLTree(AVLTree &&rr)
-    : m_root{std::move(rr.m_root)}, m_size{rr.m_size}
+template <typename KeyType, template <typename> class Storage>
+AVLTree<KeyType, Storage>::AVLTree(AVLTree &&rr)
+    : m_nodes{std::move(rr.m_nodes)}, m_root{rr.m_root}, m_size{rr.m_size}
 {
+    rr.m_root = Null;
+    rr.m_size = 0u;
 }
 
-template <typename KeyType>
-AVLTree<KeyType> &AVLTree<KeyType>::operator=(AVLTree &&rr)
+template <typename KeyType, template <typename> class Storage>
+AVLTree<KeyType, Storage> &AVLTree<KeyType, Storage>::operator=(AVLTree &&rr)
 {
-    m_root = std::move(rr.m_root);
-    m_size = rr.m_size;
+    if (this != &rr)
+    {
+        clear();
+        m_nodes = std::move(rr.m_nodes);
+        m_root = rr.m_root;
+        m_size = rr.m_size;
+
+        rr.m_root = Null;
+        rr.m_size = 0u;
+    }
     return *this;
 }
 
-template <typename KeyType>
-bool AVLTree<KeyType>::operator==(const AVLTree &other) const
+template <typename KeyType, template <typename> class Storage>
+AVLTree<KeyType, Storage>::~AVLTree()
+{
+    clear();
+}
+
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::operator==(const AVLTree &other) const
 {
     if (m_size != other.m_size)
     {
@@ -460,22 +513,22 @@ bool AVLTree<KeyType>::operator==(const AVLTree &other) const
 
     bool inequal = false;
 
-    const std::function<bool(const typename Node::Ptr &, const typename Node::Ptr &)> compareRecursive =
-        [this, &compareRecursive, &inequal](const typename Node::Ptr &node1, const typename Node::Ptr &node2) -> bool {
+    const std::function<bool(Link, Link)> compareRecursive =
+        [this, &other, &compareRecursive, &inequal](Link node1, Link node2) -> bool {
         if (inequal)
         {
             return false;
         }
 
-        if (node1 == nullptr && node2 == nullptr)
+        if (node1 == Null && node2 == Null)
         {
             return true;
         }
-        else if (node1 != nullptr && node2 != nullptr)
+        else if (node1 != Null && node2 != Null)
         {
-            if (KeyTypeTraits<KeyType>::equal(node1->key, node2->key))
+            if (KeyTypeTraits<KeyType>::equal(m_nodes[node1].key, other.m_nodes[node2].key))
             {
-                return compareRecursive(node1->left, node2->left) && compareRecursive(node1->right, node2->right);
+                return compareRecursive(m_nodes[node1].left, other.m_nodes[node2].left) && compareRecursive(m_nodes[node1].right, other.m_nodes[node2].right);
             }
         }
 
@@ -486,36 +539,44 @@ bool AVLTree<KeyType>::operator==(const AVLTree &other) const
     return compareRecursive(m_root, other.m_root);
 }
 
-template <typename KeyType>
-bool AVLTree<KeyType>::operator!=(const AVLTree &other) const
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::operator!=(const AVLTree &other) const
 {
     return !((*this) == other);
 }
 
-template <typename KeyType>
-inline void AVLTree<KeyType>::clear()
+template <typename KeyType, template <typename> class Storage>
+inline void AVLTree<KeyType, Storage>::clear()
 {
-    m_root.reset();
+    // Nodes of trivially destructible keys go away together with their chunks.
+    if constexpr (!std::is_trivially_destructible<Node>::value)
+    {
+        _destroy(m_root);
+    }
+
+    m_nodes.clear();
+    m_root = Null;
     m_size = 0u;
 }
 
-template <typename KeyType>
-inline const KeyType *AVLTree<KeyType>::insert(const KeyType &key)
+template <typename KeyType, template <typename> class Storage>
+inline const KeyType *AVLTree<KeyType, Storage>::insert(const KeyType &key)
 {
     ++m_size;
-    return _insert(m_root, key);
+    m_nodes.reserve();
+    return _insert(key);
 }
 
-template <typename KeyType>
-inline bool AVLTree<KeyType>::find(const KeyType &key) const
+template <typename KeyType, template <typename> class Storage>
+inline bool AVLTree<KeyType, Storage>::find(const KeyType &key) const
 {
-    return (_find(m_root, key) == nullptr) ? false : true;
+    return (_find(m_root, key) == Null) ? false : true;
 }
 
-template <typename KeyType>
-inline bool AVLTree<KeyType>::pop(const KeyType &key)
+template <typename KeyType, template <typename> class Storage>
+inline bool AVLTree<KeyType, Storage>::pop(const KeyType &key)
 {
-    bool popped = _pop(m_root, key);
+    bool popped = _pop(key);
     if (popped)
     {
         --m_size;
@@ -523,79 +584,123 @@ inline bool AVLTree<KeyType>::pop(const KeyType &key)
     return popped;
 }
 
-template <typename KeyType>
-inline const size_t AVLTree<KeyType>::size() const
+template <typename KeyType, template <typename> class Storage>
+inline const size_t AVLTree<KeyType, Storage>::size() const
 {
     return m_size;
 }
 
-template <typename KeyType>
-inline const size_t AVLTree<KeyType>::count(const KeyType &key) const
+template <typename KeyType, template <typename> class Storage>
+inline const size_t AVLTree<KeyType, Storage>::count(const KeyType &key) const
 {
     return _count(m_root, key);
 }
 
-template <typename KeyType>
-inline const uint8_t AVLTree<KeyType>::height() const
+template <typename KeyType, template <typename> class Storage>
+inline const uint8_t AVLTree<KeyType, Storage>::height() const
 {
     return _height(m_root);
 }
 
-template <typename KeyType>
-inline const int8_t AVLTree<KeyType>::balance() const
+template <typename KeyType, template <typename> class Storage>
+inline const int8_t AVLTree<KeyType, Storage>::balance() const
+{
+    return (m_root == Null) ? 0 : _height(m_nodes[m_root].left) - _height(m_nodes[m_root].right);
+}
+
+template <typename KeyType, template <typename> class Storage>
+inline size_t AVLTree<KeyType, Storage>::memoryUsage() const
 {
-    return _height(m_root->left) - _height(m_root->right);
+    return m_nodes.memoryUsage();
 }
 
-template <typename KeyType>
-bool AVLTree<KeyType>::findMin(KeyType &outKey)
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::findMin(KeyType &outKey)
 {
-    if (m_root != nullptr)
+    if (m_root != Null)
     {
         auto node = _minKeyNode(m_root);
-        outKey = node->key;
+        outKey = m_nodes[node].key;
         return true;
     }
 
     return false;
 }
 
-template <typename KeyType>
-bool AVLTree<KeyType>::findMax(KeyType &outKey)
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::findMax(KeyType &outKey)
 {
-    if (m_root != nullptr)
+    if (m_root != Null)
     {
-        auto node = _minKeyNode(m_root);
-        outKey = node->key;
+        auto node = _maxKeyNode(m_root);
+        outKey = m_nodes[node].key;
         return true;
     }
 
     return false;
 }
 
-template <typename KeyType>
-bool AVLTree<KeyType>::findClosest(const KeyType &key, KeyType &outKey)
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::findClosest(const KeyType &key, KeyType &outKey)
 {
     return _findClosest(m_root, key, outKey, [](const KeyType &l, const KeyType &r) -> KeyType { return KeyTypeTraits<KeyType>::abs(KeyTypeTraits<KeyType>::subtract(l, r)); });
 }
 
-template <typename KeyType>
-bool AVLTree<KeyType>::findClosestGreater(const KeyType &key, KeyType &outKey)
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::findClosestGreater(const KeyType &key, KeyType &outKey)
 {
-    return _findClosest(m_root, key, outKey,
-                        [](const KeyType &l, const KeyType &r) -> KeyType { return (KeyTypeTraits<KeyType>::greater(l, r) ? KeyTypeTraits<KeyType>::subtract(l, r) : KeyTypeTraits<KeyType>::max()); });
+    return _findBound(key, outKey, KeyTypeTraits<KeyType>::greater, true);
 }
 
-template <typename KeyType>
-bool AVLTree<KeyType>::findClosestGreaterEqual(const KeyType &key, KeyType &outKey)
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::findClosestGreaterEqual(const KeyType &key, KeyType &outKey)
 {
-    return _findClosest(m_root, key, outKey,
-                        [](const KeyType &l, const KeyType &r) -> KeyType { return (KeyTypeTraits<KeyType>::greaterEqual(l, r) ? KeyTypeTraits<KeyType>::subtract(l, r) : KeyTypeTraits<KeyType>::max()); });
+    return _findBound(key, outKey, KeyTypeTraits<KeyType>::greaterEqual, true);
 }
 
-template <typename KeyType>
-bool AVLTree<KeyType>::findClosestLesser(const KeyType &key, KeyType &outKey)
+template <typename KeyType, template <typename> class Storage>
+bool AVLTree<KeyType, Storage>::findClosestLesser(const KeyType &key, KeyType &outKey)
 {
-    return _findClosest(m_root, key, outKey,
-                        [](const KeyType &l, const KeyType &r) -> KeyType { return (KeyTypeTraits<KeyType>::less(l, r) ? KeyTypeTraits<KeyType>::subtract(r, l) : KeyTypeTraits<KeyType>::max()); });
+    return _findBound(key, outKey, KeyTypeTraits<KeyType>::less, false);
+}
+
+template <typename KeyType, template <typename> class Storage>
+template <typename Predicate>
+bool AVLTree<KeyType, Storage>::findFirstGreaterEqual(const KeyType &key, Predicate matches, KeyType &outKey)
+{
+    // Nodes still to be visited, all on one path from the root, so at most the height of the tree.
+    std::array<Link, MaxHeight> pending;
+    size_t depth = 0u;
+    Link pNode = m_root;
+
+    while (pNode != Null)
+    {
+        if (KeyTypeTraits<KeyType>::less(m_nodes[pNode].key, key))
+        {
+            pNode = m_nodes[pNode].right;
+        }
+        else
+        {
+            pending[depth++] = pNode;
+            pNode = m_nodes[pNode].left;
+        }
+    }
+
+    while (depth != 0u)
+    {
+        pNode = pending[--depth];
+
+        if (matches(m_nodes[pNode].key))
+        {
+            outKey = m_nodes[pNode].key;
+            return true;
+        }
+
+        for (pNode = m_nodes[pNode].right; pNode != Null; pNode = m_nodes[pNode].left)
+        {
+            pending[depth++] = pNode;
+        }
+    }
+
+    return false;
 }
\ No newline at end of file
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace Yaro
+{
+namespace Utility
+{
+
+enum class TraceEvent : uint32_t
+{
+    Allocate,
+    // A size smaller than the allocation releases only its head, as AVLAllocator::deallocate() does.
+    Deallocate,
+    // Resized in place to `size` bytes.
+    Resize,
+};
+
+// One event, stored as is in the trace file after the header.
+struct TraceRecord
+{
+    // Nanoseconds since the trace was opened.
+    uint64_t time;
+    uint64_t pointer;
+    uint64_t size;
+    uint32_t thread;
+    TraceEvent event;
+};
+
+// Process-wide binary trace of allocator events. Each thread appends to a buffer of its own and
+// writes it out in one piece when it fills up, when the thread exits and on flush(); close() only
+// flushes the calling thread, so other threads should flush or exit first. While no trace is
+// open, recording costs one load of a flag.
+class AllocationTrace
+{
+  public:
+    static constexpr char Magic[8] = {'A', 'V', 'L', 'T', 'R', 'A', 'C', 'E'};
+    static constexpr size_t BufferRecords = 4096u;
+
+    static bool open(const char *path)
+    {
+        State &state = _state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        if (state.file != nullptr)
+        {
+            return false;
+        }
+
+        state.file = std::fopen(path, "wb");
+
+        if (state.file == nullptr)
+        {
+            return false;
+        }
+
+        if (std::fwrite(Magic, sizeof(Magic), 1u, state.file) != 1u)
+        {
+            std::fclose(state.file);
+            state.file = nullptr;
+            return false;
+        }
+
+        state.begin = std::chrono::steady_clock::now();
+        state.enabled.store(true, std::memory_order_release);
+        return true;
+    }
+
+    static void close()
+    {
+        flush();
+
+        State &state = _state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        state.enabled.store(false, std::memory_order_release);
+
+        if (state.file != nullptr)
+        {
+            std::fclose(state.file);
+            state.file = nullptr;
+        }
+    }
+
+    static bool enabled()
+    {
+        return _state().enabled.load(std::memory_order_acquire);
+    }
+
+    static void record(TraceEvent event, const void *ptr, size_t size)
+    {
+        if (!enabled())
+        {
+            return;
+        }
+
+        Buffer &buffer = _buffer();
+        const auto elapsed = std::chrono::steady_clock::now() - _state().begin;
+
+        buffer.records.push_back({static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+                                  reinterpret_cast<uintptr_t>(ptr), size, buffer.thread, event});
+
+        if (buffer.records.size() == BufferRecords)
+        {
+            buffer.flush();
+        }
+    }
+
+    // Writes out the calling thread's buffer.
+    static void flush()
+    {
+        _buffer().flush();
+    }
+
+    // Reads a whole trace back, in the order the buffers were written. Returns false if the file
+    // cannot be opened or is not a trace.
+    static bool read(const char *path, std::vector<TraceRecord> &outRecords)
+    {
+        std::FILE *file = std::fopen(path, "rb");
+
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        char magic[sizeof(Magic)];
+        const bool valid = std::fread(magic, sizeof(magic), 1u, file) == 1u && std::memcmp(magic, Magic, sizeof(Magic)) == 0;
+
+        TraceRecord record;
+        while (valid && std::fread(&record, sizeof(record), 1u, file) == 1u)
+        {
+            outRecords.push_back(record);
+        }
+
+        std::fclose(file);
+        return valid;
+    }
+
+  private:
+    struct State
+    {
+        std::mutex mutex;
+        std::FILE *file = nullptr;
+        std::atomic<bool> enabled{false};
+        std::chrono::steady_clock::time_point begin;
+        std::atomic<uint32_t> nextThread{0u};
+    };
+
+    struct Buffer
+    {
+        std::vector<TraceRecord> records;
+        uint32_t thread;
+
+        Buffer()
+            : thread{_state().nextThread.fetch_add(1u, std::memory_order_relaxed)}
+        {
+            records.reserve(BufferRecords);
+        }
+
+        ~Buffer()
+        {
+            flush();
+        }
+
+        void flush()
+        {
+            if (records.empty())
+            {
+                return;
+            }
+
+            State &state = _state();
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+
+                if (state.file != nullptr)
+                {
+                    std::fwrite(records.data(), sizeof(TraceRecord), records.size(), state.file);
+                }
+            }
+
+            records.clear();
+        }
+    };
+
+    // Never destroyed, so threads that exit late can still flush into it.
+    static State &_state()
+    {
+        static State *state = new State;
+        return *state;
+    }
+
+    static Buffer &_buffer()
+    {
+        static thread_local Buffer buffer;
+        return buffer;
+    }
+};
+
+} // namespace Utility
+} // namespace Yaro
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Yaro
+{
+namespace Utility
+{
+
+// Allocation sizes are binned by their highest set bit; the last bin also takes everything larger.
+static constexpr size_t HistogramBins = 32u;
+
+inline size_t histogramBin(size_t byteSize)
+{
+    size_t bin = 0u;
+
+    while (byteSize > 1u && bin + 1u < HistogramBins)
+    {
+        byteSize >>= 1u;
+        ++bin;
+    }
+    return bin;
+}
+
+// Counters of one block. They are only written under the block's lock, so updates are plain
+// relaxed stores rather than read-modify-write operations, and any thread may read them at any time.
+struct BlockCounters
+{
+    std::atomic<size_t> freeBytes{0u};
+    std::atomic<size_t> freeSegments{0u};
+    std::atomic<size_t> peakUsedBytes{0u};
+    std::atomic<uint64_t> allocations{0u};
+    std::atomic<uint64_t> deallocations{0u};
+    std::array<std::atomic<uint64_t>, HistogramBins> histogram{};
+
+    template <typename Value>
+    static void add(std::atomic<Value> &counter, Value delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    template <typename Value>
+    static void sub(std::atomic<Value> &counter, Value delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) - delta, std::memory_order_relaxed);
+    }
+};
+
+struct BlockStats
+{
+    size_t capacity = 0u;
+    // Bytes of segments in use, tags, padding and slabs included.
+    size_t usedBytes = 0u;
+    size_t peakUsedBytes = 0u;
+    size_t freeBytes = 0u;
+    size_t freeSegments = 0u;
+    size_t largestFreeSegment = 0u;
+    uint64_t allocations = 0u;
+    uint64_t deallocations = 0u;
+    // Retired: empty, its pages returned to the system, skipped by allocation.
+    bool dormant = false;
+
+    // External fragmentation: the share of free memory a single request cannot reach.
+    double fragmentation() const
+    {
+        return (freeBytes == 0u) ? 0.0 : 1.0 - static_cast<double>(largestFreeSegment) / static_cast<double>(freeBytes);
+    }
+};
+
+// A snapshot of a resource. Segments parked in a thread cache count as in use.
+struct ResourceStats
+{
+    std::vector<BlockStats> blocks;
+    size_t activeBlocks = 0u;
+    // Sums over the blocks. The peak is the sum of the block peaks, which may not have coincided.
+    BlockStats total;
+    // Requests no block had a large enough free segment for.
+    uint64_t failures = 0u;
+    std::array<uint64_t, HistogramBins> histogram{};
+};
+
+} // namespace Utility
+} // namespace Yaro
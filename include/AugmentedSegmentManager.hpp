@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "SegmentManager.hpp"
+
+namespace Yaro
+{
+namespace Utility
+{
+
+// Largest segment size in a subtree of segments.
+template <typename KeyType>
+struct MaxSizeSummary
+{
+    size_t maxSize = 0u;
+
+    bool refresh(const KeyType &key, const MaxSizeSummary *left, const MaxSizeSummary *right)
+    {
+        const size_t previous = maxSize;
+        maxSize = std::max({key.size, (left != nullptr) ? left->maxSize : 0u, (right != nullptr) ? right->maxSize : 0u});
+
+        return maxSize != previous;
+    }
+};
+
+template <typename KeyType>
+using MaxSizeNodes = SummarizedCompactNodes<KeyType, MaxSizeSummary>;
+
+// Keeps free segments in a single AVL tree ordered by address. Every node also records the
+// largest segment size in its subtree, so fit searches skip subtrees that cannot hold a request
+// and each add or delete touches one tree instead of two. Requests are placed by first fit.
+class AugmentedSegmentManager
+{
+  public:
+    using SegmentBase = SegmentManager::SegmentBase;
+
+    void addSegment(const SegmentBase &segment)
+    {
+        m_segments.insert(segment);
+    }
+
+    bool deleteSegment(const SegmentBase &segment)
+    {
+        return m_segments.pop(segment);
+    }
+
+    // Smallest segment of at least `segment.size` bytes, the lowest addressed one among equals.
+    // The largest sizes only prune subtrees too small for the request, so this may visit every
+    // node; it serves comparisons, not MemoryBlock.
+    bool bestFitSegment(const SegmentBase &segment, SegmentBase &outSegment) const
+    {
+        Link best = Tree::Null;
+        _bestFit(m_segments.root(), segment.size, best);
+
+        return _found(best, outSegment);
+    }
+
+    // Lowest addressed segment of at least `segment.size` bytes.
+    bool firstFitSegment(const SegmentBase &segment, SegmentBase &outSegment) const
+    {
+        Link link = m_segments.root();
+
+        while (link != Tree::Null && _maxSize(link) >= segment.size)
+        {
+            const Node &node = m_segments.node(link);
+
+            if (_maxSize(node.left) >= segment.size)
+            {
+                link = node.left;
+            }
+            else if (node.key.size >= segment.size)
+            {
+                break;
+            }
+            else
+            {
+                link = node.right;
+            }
+        }
+
+        return _found((link != Tree::Null && _maxSize(link) >= segment.size) ? link : Tree::Null, outSegment);
+    }
+
+    // Search MemoryBlock places requests with: address-ordered first fit, unlike the best fit of
+    // the other managers. It follows a single path down the tree, while best fit may have to
+    // visit every subtree that is large enough.
+    bool fitSegment(const SegmentBase &segment, SegmentBase &outSegment) const
+    {
+        return firstFitSegment(segment, outSegment);
+    }
+
+    bool getLeftAdjacentSegment(const SegmentBase &segment, SegmentBase &outSegment)
+    {
+        Key found;
+        return _found(m_segments.findClosestLesser(segment, found), found, outSegment);
+    }
+
+    bool getRightAdjacentSegment(const SegmentBase &segment, SegmentBase &outSegment)
+    {
+        Key found;
+        return _found(m_segments.findClosestGreater(segment, found), found, outSegment);
+    }
+
+    size_t maxSizeSegment() const
+    {
+        return _maxSize(m_segments.root());
+    }
+
+    size_t memoryUsage() const
+    {
+        return m_segments.memoryUsage();
+    }
+
+  private:
+    using Key = SegmentManager::Segment<SegmentManager::HeadHeavy>;
+    using Tree = AVLTree<Key, MaxSizeNodes>;
+    using Node = Tree::Node;
+    using Link = Tree::Link;
+
+    size_t _maxSize(Link link) const
+    {
+        return (link == Tree::Null) ? 0u : m_segments.node(link).maxSize;
+    }
+
+    // Walks the subtrees that can hold `size` in address order and stops at the first exact fit.
+    bool _bestFit(Link link, size_t size, Link &best) const
+    {
+        if (_maxSize(link) < size)
+        {
+            return false;
+        }
+
+        const Node &node = m_segments.node(link);
+
+        if (_bestFit(node.left, size, best))
+        {
+            return true;
+        }
+
+        if (node.key.size >= size && (best == Tree::Null || node.key.size < m_segments.node(best).key.size))
+        {
+            best = link;
+
+            if (node.key.size == size)
+            {
+                return true;
+            }
+        }
+
+        return _bestFit(node.right, size, best);
+    }
+
+    bool _found(Link link, SegmentBase &outSegment) const
+    {
+        return link != Tree::Null && _found(true, m_segments.node(link).key, outSegment);
+    }
+
+    static bool _found(bool found, const SegmentBase &result, SegmentBase &outSegment)
+    {
+        if (found)
+        {
+            outSegment = {result.head, result.size};
+        }
+
+        return found;
+    }
+
+    Tree m_segments;
+};
+
+} // namespace Utility
+} // namespace Yaro
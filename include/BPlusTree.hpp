@@ -0,0 +1,669 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+#include "NodeArena.hpp"
+
+namespace Yaro
+{
+namespace Utility
+{
+
+// The 64-bit part of a key that B+-tree nodes search with vector compares. Keys must order by it
+// first; keys with equal primary parts are then told apart by their own comparison operators.
+template <typename KeyType>
+struct PrimaryKey
+{
+    static uint64_t of(const KeyType &key)
+    {
+        if constexpr (std::is_integral<KeyType>::value && std::is_signed<KeyType>::value)
+        {
+            return static_cast<uint64_t>(static_cast<int64_t>(key)) ^ (uint64_t{1u} << 63);
+        }
+        else if constexpr (std::is_integral<KeyType>::value)
+        {
+            return static_cast<uint64_t>(key);
+        }
+        else
+        {
+            return key.compareBy();
+        }
+    }
+};
+
+// An ordered set with the lookup interface of AVLTree, kept in a B+-tree. Every node holds up to
+// NodeKeys keys in sorted arrays, with the primary parts of the keys in an array of their own
+// that fills two cache lines; a descent reads those with SSE4.2 or AVX2 compares where the build
+// enables them. Leaves are linked both ways, so the neighbours of a key are at most one leaf away.
+template <typename KeyType>
+class BPlusTree
+{
+    static_assert(std::is_trivially_destructible<KeyType>::value, "nodes are dropped without destroying their keys");
+
+  public:
+    static constexpr size_t NodeKeys = 16u;
+
+  private:
+    // Nodes with fewer keys are merged with or refilled from a sibling.
+    static constexpr size_t MinKeys = NodeKeys / 4u;
+    static constexpr uint64_t Unused = std::numeric_limits<uint64_t>::max();
+
+    struct alignas(64) Node
+    {
+        // Slots past `count` hold Unused, so a search always compares the whole array.
+        uint64_t primary[NodeKeys];
+        KeyType keys[NodeKeys];
+        uint32_t count;
+        bool leaf;
+    };
+
+    struct Leaf : public Node
+    {
+        Leaf *prev;
+        Leaf *next;
+    };
+
+    // keys[i] is the smallest key of children[i + 1] or a lower bound of it.
+    struct Inner : public Node
+    {
+        Node *children[NodeKeys + 1u];
+    };
+
+    struct Step
+    {
+        Inner *node;
+        size_t child;
+    };
+
+    // A tree of 2^64 keys with nodes filled to MinKeys is less than 32 levels high.
+    static constexpr size_t MaxHeight = 32u;
+    using Path = std::array<Step, MaxHeight>;
+
+  public:
+    BPlusTree() = default;
+
+    BPlusTree(const BPlusTree &other) = delete;
+    BPlusTree &operator=(const BPlusTree &other) = delete;
+
+    BPlusTree(BPlusTree &&rr)
+        : m_leaves{std::move(rr.m_leaves)}, m_inners{std::move(rr.m_inners)}, m_root{rr.m_root}, m_size{rr.m_size}
+    {
+        rr.m_root = nullptr;
+        rr.m_size = 0u;
+    }
+
+    BPlusTree &operator=(BPlusTree &&rr)
+    {
+        m_leaves = std::move(rr.m_leaves);
+        m_inners = std::move(rr.m_inners);
+        m_root = rr.m_root;
+        m_size = rr.m_size;
+
+        rr.m_root = nullptr;
+        rr.m_size = 0u;
+        return *this;
+    }
+
+    void clear()
+    {
+        m_leaves.clear();
+        m_inners.clear();
+        m_root = nullptr;
+        m_size = 0u;
+    }
+
+    // Returns false if the key is already present.
+    bool insert(const KeyType &key)
+    {
+        if (m_root == nullptr)
+        {
+            m_root = _newLeaf();
+        }
+
+        Path path;
+        size_t depth = 0u;
+        Leaf *leaf = _descend(key, path, depth);
+        const size_t index = _lowerBound(*leaf, key);
+
+        if (index < leaf->count && leaf->keys[index] == key)
+        {
+            return false;
+        }
+
+        if (leaf->count < NodeKeys)
+        {
+            _insertKey(*leaf, index, key);
+        }
+        else
+        {
+            Leaf *right = _newLeaf();
+            _moveKeys(*leaf, NodeKeys / 2u, *right, 0u, NodeKeys - NodeKeys / 2u);
+
+            right->next = leaf->next;
+            right->prev = leaf;
+            if (leaf->next != nullptr)
+            {
+                leaf->next->prev = right;
+            }
+            leaf->next = right;
+
+            if (index <= leaf->count)
+            {
+                _insertKey(*leaf, index, key);
+            }
+            else
+            {
+                _insertKey(*right, index - leaf->count, key);
+            }
+
+            _insertSeparator(path, depth, right->keys[0], right);
+        }
+
+        ++m_size;
+        return true;
+    }
+
+    bool find(const KeyType &key) const
+    {
+        if (m_root == nullptr)
+        {
+            return false;
+        }
+
+        const Leaf *leaf = _descend(key);
+        const size_t index = _lowerBound(*leaf, key);
+        return index < leaf->count && leaf->keys[index] == key;
+    }
+
+    bool pop(const KeyType &key)
+    {
+        if (m_root == nullptr)
+        {
+            return false;
+        }
+
+        Path path;
+        size_t depth = 0u;
+        Leaf *leaf = _descend(key, path, depth);
+        const size_t index = _lowerBound(*leaf, key);
+
+        if (index == leaf->count || leaf->keys[index] != key)
+        {
+            return false;
+        }
+
+        _eraseKey(*leaf, index);
+        --m_size;
+        _rebalance(path, depth, leaf);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool findMax(KeyType &outKey) const
+    {
+        if (m_size == 0u)
+        {
+            return false;
+        }
+
+        const Node *node = m_root;
+        while (!node->leaf)
+        {
+            node = static_cast<const Inner *>(node)->children[node->count];
+        }
+
+        outKey = node->keys[node->count - 1u];
+        return true;
+    }
+
+    bool findMin(KeyType &outKey) const
+    {
+        if (m_size == 0u)
+        {
+            return false;
+        }
+
+        const Node *node = m_root;
+        while (!node->leaf)
+        {
+            node = static_cast<const Inner *>(node)->children[0];
+        }
+
+        outKey = node->keys[0];
+        return true;
+    }
+
+    bool findClosestGreater(const KeyType &key, KeyType &outKey) const
+    {
+        if (m_root == nullptr)
+        {
+            return false;
+        }
+
+        const Leaf *leaf = _descend(key);
+        return _keyFrom(leaf, _upperBound(*leaf, key), outKey);
+    }
+
+    bool findClosestGreaterEqual(const KeyType &key, KeyType &outKey) const
+    {
+        if (m_root == nullptr)
+        {
+            return false;
+        }
+
+        const Leaf *leaf = _descend(key);
+        return _keyFrom(leaf, _lowerBound(*leaf, key), outKey);
+    }
+
+    // Smallest key not less than `key` for which `matches` holds, visiting keys in order.
+    template <typename Predicate>
+    bool findFirstGreaterEqual(const KeyType &key, Predicate matches, KeyType &outKey) const
+    {
+        if (m_root == nullptr)
+        {
+            return false;
+        }
+
+        const Leaf *leaf = _descend(key);
+
+        for (size_t index = _lowerBound(*leaf, key); leaf != nullptr; leaf = leaf->next, index = 0u)
+        {
+            for (; index < leaf->count; ++index)
+            {
+                if (matches(leaf->keys[index]))
+                {
+                    outKey = leaf->keys[index];
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    bool findClosestLesser(const KeyType &key, KeyType &outKey) const
+    {
+        if (m_root == nullptr)
+        {
+            return false;
+        }
+
+        const Leaf *leaf = _descend(key);
+        const size_t index = _lowerBound(*leaf, key);
+
+        if (index != 0u)
+        {
+            outKey = leaf->keys[index - 1u];
+            return true;
+        }
+
+        // Only the root leaf is ever empty, and it has no neighbours.
+        if (leaf->prev == nullptr)
+        {
+            return false;
+        }
+
+        outKey = leaf->prev->keys[leaf->prev->count - 1u];
+        return true;
+    }
+
+    // Bytes held by node storage, including nodes kept for reuse.
+    size_t memoryUsage() const
+    {
+        return m_leaves.capacity() * sizeof(Leaf) + m_inners.capacity() * sizeof(Inner);
+    }
+
+    static constexpr size_t leafSize()
+    {
+        return sizeof(Leaf);
+    }
+
+  private:
+    // Number of used slots whose primary part is below `value`.
+    static size_t _countBelow(const uint64_t *primary, uint64_t value)
+    {
+        size_t count = 0u;
+
+#if defined(__AVX2__)
+        // There is no unsigned 64-bit compare; flipping the sign bit maps the order onto the signed one.
+        const __m256i bias = _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+        const __m256i target = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(value)), bias);
+
+        for (size_t i = 0u; i < NodeKeys; i += 4u)
+        {
+            const __m256i keys = _mm256_xor_si256(_mm256_load_si256(reinterpret_cast<const __m256i *>(primary + i)), bias);
+            count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(target, keys))));
+        }
+#elif defined(__SSE4_2__)
+        const __m128i bias = _mm_set1_epi64x(std::numeric_limits<int64_t>::min());
+        const __m128i target = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(value)), bias);
+
+        for (size_t i = 0u; i < NodeKeys; i += 2u)
+        {
+            const __m128i keys = _mm_xor_si128(_mm_load_si128(reinterpret_cast<const __m128i *>(primary + i)), bias);
+            count += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(target, keys))));
+        }
+#else
+        for (size_t i = 0u; i < NodeKeys; ++i)
+        {
+            count += (primary[i] < value) ? 1u : 0u;
+        }
+#endif
+
+        return count;
+    }
+
+    // First slot whose key is not less than `key`.
+    static size_t _lowerBound(const Node &node, const KeyType &key)
+    {
+        const uint64_t primary = PrimaryKey<KeyType>::of(key);
+        size_t index = _countBelow(node.primary, primary);
+
+        while (index < node.count && node.primary[index] == primary && node.keys[index] < key)
+        {
+            ++index;
+        }
+        return index;
+    }
+
+    // First slot whose key is greater than `key`.
+    static size_t _upperBound(const Node &node, const KeyType &key)
+    {
+        const uint64_t primary = PrimaryKey<KeyType>::of(key);
+        size_t index = _countBelow(node.primary, primary);
+
+        while (index < node.count && node.primary[index] == primary && node.keys[index] <= key)
+        {
+            ++index;
+        }
+        return index;
+    }
+
+    const Leaf *_descend(const KeyType &key) const
+    {
+        const Node *node = m_root;
+
+        while (!node->leaf)
+        {
+            node = static_cast<const Inner *>(node)->children[_upperBound(*node, key)];
+        }
+
+        return static_cast<const Leaf *>(node);
+    }
+
+    Leaf *_descend(const KeyType &key, Path &path, size_t &depth)
+    {
+        Node *node = m_root;
+
+        while (!node->leaf)
+        {
+            Inner *inner = static_cast<Inner *>(node);
+            const size_t child = _upperBound(*inner, key);
+
+            path[depth++] = {inner, child};
+            node = inner->children[child];
+        }
+
+        return static_cast<Leaf *>(node);
+    }
+
+    // The key in `index` of `leaf`, or the first key of the next leaf if `index` is past its end.
+    static bool _keyFrom(const Leaf *leaf, size_t index, KeyType &outKey)
+    {
+        if (index == leaf->count)
+        {
+            leaf = leaf->next;
+            index = 0u;
+        }
+
+        if (leaf == nullptr || index == leaf->count)
+        {
+            return false;
+        }
+
+        outKey = leaf->keys[index];
+        return true;
+    }
+
+    Leaf *_newLeaf()
+    {
+        Leaf *leaf = m_leaves.create();
+        std::fill(leaf->primary, leaf->primary + NodeKeys, Unused);
+        leaf->count = 0u;
+        leaf->leaf = true;
+        leaf->prev = nullptr;
+        leaf->next = nullptr;
+        return leaf;
+    }
+
+    Inner *_newInner()
+    {
+        Inner *inner = m_inners.create();
+        std::fill(inner->primary, inner->primary + NodeKeys, Unused);
+        inner->count = 0u;
+        inner->leaf = false;
+        return inner;
+    }
+
+    static void _insertKey(Node &node, size_t index, const KeyType &key)
+    {
+        std::copy_backward(node.primary + index, node.primary + node.count, node.primary + node.count + 1u);
+        std::copy_backward(node.keys + index, node.keys + node.count, node.keys + node.count + 1u);
+
+        node.primary[index] = PrimaryKey<KeyType>::of(key);
+        node.keys[index] = key;
+        ++node.count;
+    }
+
+    static void _eraseKey(Node &node, size_t index)
+    {
+        std::copy(node.primary + index + 1u, node.primary + node.count, node.primary + index);
+        std::copy(node.keys + index + 1u, node.keys + node.count, node.keys + index);
+
+        --node.count;
+        node.primary[node.count] = Unused;
+    }
+
+    // Moves the `count` keys from slot `from` on of `source` to slot `to` of `target`, which has
+    // no keys from there on. The keys have to be the last ones of `source`.
+    static void _moveKeys(Node &source, size_t from, Node &target, size_t to, size_t count)
+    {
+        std::copy(source.primary + from, source.primary + from + count, target.primary + to);
+        std::copy(source.keys + from, source.keys + from + count, target.keys + to);
+        std::fill(source.primary + from, source.primary + from + count, Unused);
+
+        source.count -= static_cast<uint32_t>(count);
+        target.count += static_cast<uint32_t>(count);
+    }
+
+    // Links `right`, split off the node reached through the last step of `path`, into its parent
+    // with `separator`, splitting inner nodes up to the root as long as they are full.
+    void _insertSeparator(Path &path, size_t depth, KeyType separator, Node *right)
+    {
+        while (depth != 0u)
+        {
+            const Step step = path[--depth];
+            Inner &inner = *step.node;
+
+            if (inner.count < NodeKeys)
+            {
+                _insertKey(inner, step.child, separator);
+                std::copy_backward(inner.children + step.child + 1u, inner.children + inner.count,
+                                   inner.children + inner.count + 1u);
+                inner.children[step.child + 1u] = right;
+                return;
+            }
+
+            // Lay out all NodeKeys + 1 separators in order, then keep the lower half, pass the
+            // middle one up and move the upper half to a new node.
+            KeyType keys[NodeKeys + 1u];
+            Node *children[NodeKeys + 2u];
+
+            std::copy(inner.keys, inner.keys + step.child, keys);
+            keys[step.child] = separator;
+            std::copy(inner.keys + step.child, inner.keys + NodeKeys, keys + step.child + 1u);
+
+            std::copy(inner.children, inner.children + step.child + 1u, children);
+            children[step.child + 1u] = right;
+            std::copy(inner.children + step.child + 1u, inner.children + NodeKeys + 1u, children + step.child + 2u);
+
+            constexpr size_t Half = NodeKeys / 2u;
+            Inner *sibling = _newInner();
+
+            inner.count = 0u;
+            std::fill(inner.primary, inner.primary + NodeKeys, Unused);
+
+            for (size_t i = 0u; i < Half; ++i)
+            {
+                _insertKey(inner, i, keys[i]);
+            }
+            std::copy(children, children + Half + 1u, inner.children);
+
+            for (size_t i = Half + 1u; i <= NodeKeys; ++i)
+            {
+                _insertKey(*sibling, i - Half - 1u, keys[i]);
+            }
+            std::copy(children + Half + 1u, children + NodeKeys + 2u, sibling->children);
+
+            separator = keys[Half];
+            right = sibling;
+        }
+
+        Inner *root = _newInner();
+        _insertKey(*root, 0u, separator);
+        root->children[0] = m_root;
+        root->children[1] = right;
+        m_root = root;
+    }
+
+    // Refills `node`, reached through `path`, once it runs short of keys: merges it with a
+    // sibling if both fit in one node and moves a single key over otherwise. Merging takes a
+    // key off the parent, which may then need the same.
+    void _rebalance(Path &path, size_t depth, Node *node)
+    {
+        while (depth != 0u && node->count < MinKeys)
+        {
+            const Step step = path[--depth];
+            Inner &parent = *step.node;
+
+            // The pair of siblings is `left` and `right`, with `parent.keys[index]` between them.
+            const size_t index = (step.child == parent.count) ? step.child - 1u : step.child;
+            Node *left = parent.children[index];
+            Node *right = parent.children[index + 1u];
+            const size_t merged = left->count + right->count + (node->leaf ? 0u : 1u);
+
+            if (merged > NodeKeys)
+            {
+                _shift(parent, index, *left, *right, node == left);
+                return;
+            }
+
+            if (node->leaf)
+            {
+                Leaf *rightLeaf = static_cast<Leaf *>(right);
+
+                _moveKeys(*rightLeaf, 0u, *left, left->count, rightLeaf->count);
+                static_cast<Leaf *>(left)->next = rightLeaf->next;
+                if (rightLeaf->next != nullptr)
+                {
+                    rightLeaf->next->prev = static_cast<Leaf *>(left);
+                }
+                m_leaves.destroy(rightLeaf);
+            }
+            else
+            {
+                Inner *leftInner = static_cast<Inner *>(left);
+                Inner *rightInner = static_cast<Inner *>(right);
+
+                std::copy(rightInner->children, rightInner->children + rightInner->count + 1u,
+                          leftInner->children + leftInner->count + 1u);
+                _insertKey(*leftInner, leftInner->count, parent.keys[index]);
+                _moveKeys(*rightInner, 0u, *leftInner, leftInner->count, rightInner->count);
+                m_inners.destroy(rightInner);
+            }
+
+            _eraseKey(parent, index);
+            std::copy(parent.children + index + 2u, parent.children + parent.count + 2u, parent.children + index + 1u);
+            node = &parent;
+        }
+
+        if (!m_root->leaf && m_root->count == 0u)
+        {
+            Inner *root = static_cast<Inner *>(m_root);
+            m_root = root->children[0];
+            m_inners.destroy(root);
+        }
+    }
+
+    // Moves one key into the short one of two siblings, rotating it through the parent's
+    // separator `parent.keys[index]` when they are inner nodes.
+    static void _shift(Inner &parent, size_t index, Node &left, Node &right, bool intoLeft)
+    {
+        if (left.leaf)
+        {
+            if (intoLeft)
+            {
+                _insertKey(left, left.count, right.keys[0]);
+                _eraseKey(right, 0u);
+            }
+            else
+            {
+                _insertKey(right, 0u, left.keys[left.count - 1u]);
+                _eraseKey(left, left.count - 1u);
+            }
+
+            parent.keys[index] = right.keys[0];
+            parent.primary[index] = right.primary[0];
+            return;
+        }
+
+        Inner &leftInner = static_cast<Inner &>(left);
+        Inner &rightInner = static_cast<Inner &>(right);
+
+        if (intoLeft)
+        {
+            _insertKey(leftInner, leftInner.count, parent.keys[index]);
+            leftInner.children[leftInner.count] = rightInner.children[0];
+
+            parent.keys[index] = rightInner.keys[0];
+            parent.primary[index] = rightInner.primary[0];
+
+            _eraseKey(rightInner, 0u);
+            std::copy(rightInner.children + 1u, rightInner.children + rightInner.count + 2u, rightInner.children);
+        }
+        else
+        {
+            std::copy_backward(rightInner.children, rightInner.children + rightInner.count + 1u,
+                               rightInner.children + rightInner.count + 2u);
+            rightInner.children[0] = leftInner.children[leftInner.count];
+            _insertKey(rightInner, 0u, parent.keys[index]);
+
+            parent.keys[index] = leftInner.keys[leftInner.count - 1u];
+            parent.primary[index] = leftInner.primary[leftInner.count - 1u];
+
+            _eraseKey(leftInner, leftInner.count - 1u);
+        }
+    }
+
+    NodeArena<Leaf> m_leaves;
+    NodeArena<Inner> m_inners;
+    Node *m_root = nullptr;
+    size_t m_size = 0u;
+};
+
+} // namespace Utility
+} // namespace Yaro
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <memory>
+
+namespace Yaro
+{
+namespace Utility
+{
+
+// Tournament tree over the largest free segment of every block slot. Each inner node holds the
+// larger value of its children, so the root is the largest free segment of the whole resource
+// and a descent finds a block that fits a request without visiting the others.
+//
+// Updates are lock-free: a block publishes its leaf under its own lock, then recomputes the
+// ancestors with compare-and-swap, retrying until each agrees with its children. Readers may
+// briefly see a value that is about to change, so a slot returned by find() is a hint and npos
+// does not prove that no block has room.
+class BlockIndex
+{
+  public:
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    explicit BlockIndex(size_t numSlots)
+        : m_numSlots{numSlots}, m_leaves{_leavesFor(numSlots)}, m_nodes{new Node[2u * m_leaves]()}
+    {
+    }
+
+    void update(size_t slot, size_t largest)
+    {
+        size_t node = m_leaves + slot;
+
+        if (m_nodes[node].value.exchange(largest) == largest)
+        {
+            return;
+        }
+
+        for (node /= 2u; node != 0u; node /= 2u)
+        {
+            size_t current = m_nodes[node].value.load();
+            size_t value = _childMax(node);
+
+            // Ancestors already agree with this subtree, or a concurrent update carries it up.
+            if (value == current)
+            {
+                return;
+            }
+
+            // The children may change between reading them and the write, so a value computed
+            // from stale children could overwrite a newer one. Every write is checked against
+            // the children again and redone until they agree with it.
+            do
+            {
+                if (m_nodes[node].value.compare_exchange_weak(current, value))
+                {
+                    current = value;
+                }
+                value = _childMax(node);
+            } while (value != current);
+        }
+    }
+
+    size_t max() const
+    {
+        return m_nodes[1].value.load(std::memory_order_acquire);
+    }
+
+    size_t largest(size_t slot) const
+    {
+        return m_nodes[m_leaves + slot].value.load(std::memory_order_acquire);
+    }
+
+    // A slot whose largest free segment holds `size` bytes, `preferred` if it does and otherwise
+    // the lowest one, or npos if no slot does.
+    size_t find(size_t size, size_t preferred) const
+    {
+        if (preferred < m_numSlots && largest(preferred) >= size)
+        {
+            return preferred;
+        }
+
+        if (max() < size)
+        {
+            return npos;
+        }
+
+        size_t node = 1u;
+
+        while (node < m_leaves)
+        {
+            node *= 2u;
+            node += (m_nodes[node].value.load(std::memory_order_acquire) >= size) ? 0u : 1u;
+        }
+
+        // A descent that raced with updates may end on an unused slot.
+        return std::min(node - m_leaves, m_numSlots - 1u);
+    }
+
+  private:
+    // One node per cache line, so blocks publishing at the same time do not share lines.
+    struct alignas(64) Node
+    {
+        std::atomic<size_t> value{0u};
+    };
+
+    size_t _childMax(size_t node) const
+    {
+        return std::max(m_nodes[2u * node].value.load(), m_nodes[2u * node + 1u].value.load());
+    }
+
+    static size_t _leavesFor(size_t numSlots)
+    {
+        size_t leaves = 1u;
+        while (leaves < numSlots)
+        {
+            leaves *= 2u;
+        }
+        return leaves;
+    }
+
+    size_t m_numSlots;
+    size_t m_leaves;
+    std::unique_ptr<Node[]> m_nodes;
+};
+
+} // namespace Utility
+} // namespace Yaro
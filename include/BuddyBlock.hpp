@@ -0,0 +1,604 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "AllocatorStats.hpp"
+#include "BitScan.hpp"
+#include "PageBuffer.hpp"
+#include "SlabPool.hpp"
+
+namespace Yaro
+{
+namespace Utility
+{
+
+// A block run as a binary buddy system, with the interface of MemoryBlock. Every segment is a
+// power of two in size and aligned to it relative to the pool, so the buddy of a segment is its
+// offset with the size bit flipped. A request takes the smallest free segment of a large enough
+// order, halving it down to the order it needs; a release merges with its buddy for as long as
+// the buddy is free and whole. Neither visits anything but one free list per order.
+//
+// Segments carry no tag, so a power-of-two request fills its segment exactly. Instead a table
+// holds an entry per MinSize bytes, set only at segment heads: the order, whether it is in use,
+// and the slack behind the requested range. A pool that is no power of two starts out as one
+// segment per set bit of its capacity, largest first; those never merge with each other.
+template <bool HugePages = false, size_t SlabSize = 4096u>
+struct BuddyBlock
+{
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+    // Alignment every allocation has at least, as with MemoryBlock.
+    static constexpr size_t Granularity = 16u;
+    static constexpr size_t MinOrder = 6u;
+    static constexpr size_t MinSize = size_t{1u} << MinOrder;
+    static constexpr size_t MaxOrder = 63u;
+
+    // Pages of a released range go back to the system once it is part of a free segment this large.
+    static constexpr size_t DiscardSize = 64u * 1024u;
+    // Queued releases are released this many at a time.
+    static constexpr size_t RemoteBatch = 64u;
+
+    using Slabs = SlabPool<SlabSize>;
+
+    // Guards the other members. Taken by the owner, never by the block itself.
+    std::mutex mutex;
+    const size_t capacity;
+    Slabs slabs;
+    PageBuffer pool;
+    BlockCounters counters;
+    // Set while the block is retired: it holds nothing and its pages went back to the system.
+    bool dormant = false;
+    // When the last allocation of the block was released.
+    std::chrono::steady_clock::time_point idleSince = std::chrono::steady_clock::now();
+    // Whole allocations released without the lock, linked through their first word. Any thread
+    // may push; whoever holds the lock takes the whole list at once, so there is no ABA.
+    std::atomic<Byte *> remoteFrees{nullptr};
+
+    explicit BuddyBlock(size_t blockSize)
+        : capacity{capacityFor(blockSize)}, slabs(capacity), pool(capacity, HugePages), m_heads(capacity / MinSize)
+    {
+        _addInitial();
+    }
+
+    // Segment heads are multiples of MinSize, fewer than 2^32 of them.
+    static size_t capacityFor(size_t blockSize)
+    {
+        return std::max(_alignUp(blockSize, MinSize), MinSize);
+    }
+
+    // Size of the segment a request of `byteSize` bytes takes.
+    static size_t segmentSize(size_t byteSize)
+    {
+        return size_t{1u} << _orderFor(byteSize);
+    }
+
+    // Largest request a free segment of `size` bytes, or a fresh pool of that capacity, can hold.
+    static size_t roomIn(size_t size)
+    {
+        return (size < MinSize) ? 0u : size_t{1u} << highestSetBit(size);
+    }
+
+    BuddyBlock(const BuddyBlock &other) = delete;
+    BuddyBlock &operator=(const BuddyBlock &other) = delete;
+    BuddyBlock(BuddyBlock &&rr) = delete;
+    BuddyBlock &operator=(BuddyBlock &&rr) = delete;
+
+    // Takes a segment holding `byteSize` bytes at an address that is a multiple of `alignment`.
+    // Segments are aligned to their size, so only alignments beyond the pool's own cost more
+    // than a segment of the alignment; those are served from inside a segment that is larger
+    // by the alignment. Returns nullptr if no free segment is large enough.
+    Byte *allocate(size_t byteSize, size_t alignment = Granularity)
+    {
+        const uintptr_t base = reinterpret_cast<uintptr_t>(pool.data());
+        const bool aligned = (base & (alignment - 1u)) == 0u;
+        const size_t order = aligned ? _orderFor(std::max(byteSize, alignment)) : _orderFor(byteSize + alignment);
+
+        if (order > MaxOrder)
+        {
+            return nullptr;
+        }
+
+        const uint64_t candidates = m_orders & (~uint64_t{0u} << order);
+
+        if (candidates == 0u)
+        {
+            return nullptr;
+        }
+
+        size_t found = lowestSetBit(candidates);
+        const size_t head = m_lists[found];
+
+        _unlink(head, found);
+
+        // The upper halves stay behind, one free segment per order in between.
+        while (found > order)
+        {
+            --found;
+            _link(head + (size_t{1u} << found), found);
+        }
+
+        const size_t offset = aligned ? head : _alignUp(base + head, alignment) - base;
+
+        _setUsed(head, order, head + (size_t{1u} << order) - offset - byteSize);
+        BlockCounters::sub(counters.freeBytes, size_t{1u} << order);
+
+        return &pool[offset];
+    }
+
+    // Releases the segment `ptr` points into, merging it with its buddy as long as that is free.
+    // A non-zero byte count smaller than the requested range releases the leading halves of the
+    // segment it covers and returns the pointer to the part that stays allocated. Throws
+    // std::bad_alloc on a segment that is not in use.
+    Byte *deallocate(Byte *ptr, size_t count)
+    {
+        const size_t offset = ptr - pool.data();
+        size_t head = _usedHeadOf(offset);
+        size_t order = _order(head);
+
+        const size_t end = head + (size_t{1u} << order);
+        const size_t slack = _slack(head, order);
+        const size_t requested = end - slack - offset;
+
+        if (count > requested)
+        {
+            throw std::bad_alloc();
+        }
+
+        if (count == 0u || count == requested)
+        {
+            _release(head, order);
+            return nullptr;
+        }
+
+        const size_t keep = offset + count;
+        size_t released = 0u;
+
+        while (order > MinOrder && keep - head >= (size_t{1u} << (order - 1u)))
+        {
+            // The upper half stays in use, so the lower one has no buddy to merge with.
+            --order;
+            _link(head, order);
+            released += size_t{1u} << order;
+            head += size_t{1u} << order;
+        }
+
+        if (released != 0u)
+        {
+            _setUsed(head, order, slack);
+            BlockCounters::add(counters.freeBytes, released);
+        }
+
+        return ptr + count;
+    }
+
+    // Changes the requested range of the segment `ptr` points into to `byteSize` bytes from `ptr`
+    // without moving it. Shrinking releases the upper halves the range no longer reaches; growing
+    // takes the buddies above the segment for as long as they are free. Returns false if they fall
+    // short.
+    bool resize(Byte *ptr, size_t byteSize)
+    {
+        const size_t offset = ptr - pool.data();
+
+        // Slab objects record no requested size, so one of another class could not be released.
+        if (ownsSmall(ptr))
+        {
+            return Slabs::fits(byteSize) && Slabs::classSize(byteSize) == slabs.objectSize(pool.data(), offset) &&
+                   byteSize <= slabs.roomAt(pool.data(), offset);
+        }
+
+        const size_t head = _usedHeadOf(offset);
+        const size_t newEnd = offset + byteSize;
+        size_t order = _order(head);
+
+        if (newEnd > head + (size_t{1u} << order))
+        {
+            size_t grown = order;
+
+            for (; newEnd > head + (size_t{1u} << grown); ++grown)
+            {
+                const size_t buddy = head ^ (size_t{1u} << grown);
+
+                if (grown == MaxOrder || buddy < head || !_isFree(buddy, grown))
+                {
+                    return false;
+                }
+            }
+
+            for (; order < grown; ++order)
+            {
+                const size_t buddy = head + (size_t{1u} << order);
+
+                _unlink(buddy, order);
+                m_heads[buddy / MinSize] = 0u;
+                BlockCounters::sub(counters.freeBytes, size_t{1u} << order);
+            }
+        }
+
+        while (order > MinOrder && newEnd - head <= (size_t{1u} << (order - 1u)))
+        {
+            // The lower half stays in use, so the upper one has no buddy to merge with.
+            --order;
+            _link(head + (size_t{1u} << order), order);
+            BlockCounters::add(counters.freeBytes, size_t{1u} << order);
+        }
+
+        _setUsed(head, order, head + (size_t{1u} << order) - newEnd);
+        return true;
+    }
+
+    // Releases whole allocations. A merge costs a few bit operations per segment, so unlike
+    // MemoryBlock there is nothing to gain from merging runs of neighbours first.
+    // Throws std::bad_alloc on a segment that is not in use.
+    template <typename T>
+    void deallocateBulk(T *const *ptrs, size_t count)
+    {
+        for (size_t i = 0u; i < count; ++i)
+        {
+            Byte *ptr = reinterpret_cast<Byte *>(ptrs[i]);
+
+            if (!ownsSmall(ptr))
+            {
+                deallocate(ptr, 0u);
+            }
+            else if (!deallocateSmall(ptr - pool.data()))
+            {
+                throw std::bad_alloc();
+            }
+        }
+    }
+
+    // Queues a whole allocation for release by the next holder of the lock. Lock-free.
+    void pushRemote(Byte *ptr)
+    {
+        Byte *head = remoteFrees.load(std::memory_order_relaxed);
+
+        do
+        {
+            std::memcpy(ptr, &head, sizeof(head));
+        } while (!remoteFrees.compare_exchange_weak(head, ptr, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Expects the lock to be held. Releases everything pushRemote() queued. Returns how many
+    // allocations were released.
+    size_t drainRemote()
+    {
+        Byte *ptr = remoteFrees.exchange(nullptr, std::memory_order_acquire);
+        size_t drained = 0u;
+
+        while (ptr != nullptr)
+        {
+            Byte *batch[RemoteBatch];
+            size_t count = 0u;
+
+            for (; ptr != nullptr && count < RemoteBatch; ++count)
+            {
+                batch[count] = ptr;
+                std::memcpy(&ptr, ptr, sizeof(ptr));
+            }
+
+            deallocateBulk(batch, count);
+            drained += count;
+        }
+
+        return drained;
+    }
+
+    Byte *allocateSmall(size_t byteSize)
+    {
+        return slabs.allocate(pool.data(), byteSize, [this]() -> size_t {
+            Byte *slab = allocate(SlabSize, SlabSize);
+            return (slab == nullptr) ? Slabs::npos : slab - pool.data();
+        });
+    }
+
+    bool deallocateSmall(size_t offset)
+    {
+        return slabs.deallocate(pool.data(), offset, [this](size_t slab) -> void { deallocate(&pool[slab], 0u); });
+    }
+
+    bool contains(const Byte *ptr) const
+    {
+        return ptr >= pool.data() && ptr < pool.data() + capacity;
+    }
+
+    bool ownsSmall(const Byte *ptr) const
+    {
+        return slabs.owns(pool.data(), ptr - pool.data());
+    }
+
+    // Counts a request served by this block. Expects the block's mutex to be held.
+    void countAllocation(size_t byteSize)
+    {
+        BlockCounters::add(counters.allocations, uint64_t{1u});
+        BlockCounters::add(counters.histogram[histogramBin(byteSize)], uint64_t{1u});
+        updatePeak();
+    }
+
+    // Raises the peak to the bytes in use now. Expects the block's mutex to be held.
+    void updatePeak()
+    {
+        const size_t used = capacity - counters.freeBytes.load(std::memory_order_relaxed);
+
+        if (used > counters.peakUsedBytes.load(std::memory_order_relaxed))
+        {
+            counters.peakUsedBytes.store(used, std::memory_order_relaxed);
+        }
+    }
+
+    // Counter snapshot, safe to take without the lock. The largest free segment is left to the
+    // owner, which has to lock the block to read it.
+    BlockStats stats() const
+    {
+        BlockStats stats;
+
+        stats.capacity = capacity;
+        stats.freeBytes = counters.freeBytes.load(std::memory_order_relaxed);
+        stats.usedBytes = capacity - stats.freeBytes;
+        stats.peakUsedBytes = counters.peakUsedBytes.load(std::memory_order_relaxed);
+        stats.freeSegments = counters.freeSegments.load(std::memory_order_relaxed);
+        stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+        stats.deallocations = counters.deallocations.load(std::memory_order_relaxed);
+
+        return stats;
+    }
+
+    size_t liveAllocations() const
+    {
+        return counters.allocations.load(std::memory_order_relaxed) - counters.deallocations.load(std::memory_order_relaxed);
+    }
+
+    // Returns the block to its initial state and every page of it to the system. Only valid
+    // while it holds no allocation; cached empty slabs are dropped.
+    void reset()
+    {
+        slabs = Slabs(capacity);
+        counters.freeBytes.store(0u, std::memory_order_relaxed);
+        counters.freeSegments.store(0u, std::memory_order_relaxed);
+        std::fill(m_heads.begin(), m_heads.end(), uint16_t{0u});
+        m_orders = 0u;
+
+        pool.discard(0u, capacity);
+        _addInitial();
+    }
+
+    // Expects the lock to be held.
+    size_t largestFreeSegment() const
+    {
+        return (m_orders == 0u) ? 0u : size_t{1u} << highestSetBit(m_orders);
+    }
+
+    // Largest request a single allocate() call can currently satisfy.
+    size_t maxAllocation() const
+    {
+        return largestFreeSegment();
+    }
+
+  private:
+    // Links of a free segment, at its head. Heads are stored in units of MinSize.
+    struct Link
+    {
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    static constexpr uint32_t Null = std::numeric_limits<uint32_t>::max();
+
+    // A head entry is the order, the used bit and, for segments in use, the slack in the bits
+    // above. Slack too large for them is kept in the last word of the segment, which it covers.
+    static constexpr uint16_t OrderMask = 0x3fu;
+    static constexpr uint16_t Used = 0x40u;
+    static constexpr size_t SlackShift = 7u;
+    static constexpr size_t SlackInSegment = 0x1ffu;
+
+    static_assert(SlackInSegment >= sizeof(size_t) && MinSize >= sizeof(Link), "segments must hold their records");
+
+    static size_t _alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1u) / alignment * alignment;
+    }
+
+    // One past MaxOrder for requests no segment can hold.
+    static size_t _orderFor(size_t byteSize)
+    {
+        if (byteSize <= MinSize)
+        {
+            return MinOrder;
+        }
+
+        return (byteSize > (size_t{1u} << MaxOrder)) ? MaxOrder + 1u : highestSetBit(byteSize - 1u) + 1u;
+    }
+
+    void _addInitial()
+    {
+        size_t head = 0u;
+
+        for (size_t rest = capacity; rest >= MinSize; rest -= size_t{1u} << highestSetBit(rest))
+        {
+            const size_t order = highestSetBit(rest);
+
+            _link(head, order);
+            BlockCounters::add(counters.freeBytes, size_t{1u} << order);
+            head += size_t{1u} << order;
+        }
+    }
+
+    void _release(size_t head, size_t order)
+    {
+        const size_t releasedHead = head;
+        const size_t releasedEnd = head + (size_t{1u} << order);
+
+        BlockCounters::add(counters.freeBytes, size_t{1u} << order);
+
+        for (; order < MaxOrder; ++order)
+        {
+            const size_t buddy = head ^ (size_t{1u} << order);
+
+            if (!_isFree(buddy, order))
+            {
+                break;
+            }
+
+            _unlink(buddy, order);
+
+            // The upper head of the pair is no head anymore.
+            m_heads[std::max(head, buddy) / MinSize] = 0u;
+            head = std::min(head, buddy);
+        }
+
+        if ((size_t{1u} << order) >= DiscardSize)
+        {
+            // Only the newly released range is advised, so merging into a large free segment
+            // does not hand the same pages back over and over.
+            const size_t begin = std::max(releasedHead, head + sizeof(Link));
+
+            if (begin < releasedEnd)
+            {
+                pool.discard(begin, releasedEnd - begin);
+            }
+        }
+
+        _link(head, order);
+    }
+
+    // Whether a whole free segment of `order` starts at `head`. Without one, the range is in use
+    // or split, or part of the pool's unpaired tail.
+    bool _isFree(size_t head, size_t order) const
+    {
+        return head + (size_t{1u} << order) <= capacity && m_heads[head / MinSize] == order;
+    }
+
+    // Head of the segment in use that `offset` points into. Segments are aligned to their size,
+    // so it is the offset rounded down to the first order at which a head covers it.
+    // Throws std::bad_alloc if there is none.
+    size_t _usedHeadOf(size_t offset) const
+    {
+        if (offset >= capacity)
+        {
+            throw std::bad_alloc();
+        }
+
+        for (size_t order = MinOrder; order <= MaxOrder && (size_t{1u} << order) <= capacity; ++order)
+        {
+            const size_t head = offset & ~((size_t{1u} << order) - 1u);
+            const uint16_t entry = m_heads[head / MinSize];
+
+            if (entry != 0u && head + (size_t{1u} << (entry & OrderMask)) > offset)
+            {
+                if ((entry & Used) == 0u)
+                {
+                    break;
+                }
+                return head;
+            }
+        }
+
+        throw std::bad_alloc();
+    }
+
+    size_t _order(size_t head) const
+    {
+        return m_heads[head / MinSize] & OrderMask;
+    }
+
+    size_t _slack(size_t head, size_t order) const
+    {
+        size_t slack = m_heads[head / MinSize] >> SlackShift;
+
+        if (slack == SlackInSegment)
+        {
+            std::memcpy(&slack, &pool[head + (size_t{1u} << order) - sizeof(slack)], sizeof(slack));
+        }
+
+        return slack;
+    }
+
+    void _setUsed(size_t head, size_t order, size_t slack)
+    {
+        m_heads[head / MinSize] = static_cast<uint16_t>(order | Used | (std::min(slack, SlackInSegment) << SlackShift));
+
+        if (slack >= SlackInSegment)
+        {
+            std::memcpy(&pool[head + (size_t{1u} << order) - sizeof(slack)], &slack, sizeof(slack));
+        }
+    }
+
+    void _link(size_t head, size_t order)
+    {
+        const uint32_t link = static_cast<uint32_t>(head / MinSize);
+        const uint32_t next = (m_orders & (uint64_t{1u} << order)) ? static_cast<uint32_t>(m_lists[order] / MinSize) : Null;
+
+        _writeLink(head, {Null, next});
+
+        if (next != Null)
+        {
+            Link nextLink = _readLink(m_lists[order]);
+            nextLink.prev = link;
+            _writeLink(m_lists[order], nextLink);
+        }
+
+        m_lists[order] = head;
+        m_orders |= uint64_t{1u} << order;
+        m_heads[link] = static_cast<uint16_t>(order);
+        BlockCounters::add(counters.freeSegments, size_t{1u});
+    }
+
+    void _unlink(size_t head, size_t order)
+    {
+        const Link link = _readLink(head);
+
+        if (link.prev != Null)
+        {
+            Link prev = _readLink(link.prev * MinSize);
+            prev.next = link.next;
+            _writeLink(link.prev * MinSize, prev);
+        }
+        else if (link.next != Null)
+        {
+            m_lists[order] = link.next * MinSize;
+        }
+        else
+        {
+            m_orders &= ~(uint64_t{1u} << order);
+        }
+
+        if (link.next != Null)
+        {
+            Link next = _readLink(link.next * MinSize);
+            next.prev = link.prev;
+            _writeLink(link.next * MinSize, next);
+        }
+
+        BlockCounters::sub(counters.freeSegments, size_t{1u});
+    }
+
+    Link _readLink(size_t head) const
+    {
+        Link link;
+        std::memcpy(&link, &pool[head], sizeof(link));
+        return link;
+    }
+
+    void _writeLink(size_t head, const Link &link)
+    {
+        std::memcpy(&pool[head], &link, sizeof(link));
+    }
+
+    // Head entries, one per MinSize bytes of the pool; zero wherever no segment starts.
+    std::vector<uint16_t> m_heads;
+    // Bit `order` is set while the list of that order holds a segment.
+    uint64_t m_orders = 0u;
+    // Head of the first free segment of every order.
+    std::array<size_t, MaxOrder + 1u> m_lists{};
+};
+
+} // namespace Utility
+} // namespace Yaro
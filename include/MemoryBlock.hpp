@@ -0,0 +1,573 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+#include "AllocatorStats.hpp"
+#include "PageBuffer.hpp"
+#include "SegmentManager.hpp"
+#include "SlabPool.hpp"
+
+namespace Yaro
+{
+namespace Utility
+{
+
+template <typename Manager = SegmentManager, bool HugePages = false, size_t SlabSize = 4096u>
+struct MemoryBlock
+{
+    using SegmentBase = typename Manager::SegmentBase;
+
+    // Every segment of the pool starts with a tag. Free segments also repeat their size in
+    // their last word, so both neighbours of a released segment are reached by pointer arithmetic.
+    struct Tag
+    {
+        size_t sizeAndFlags;
+        // Bytes between the end of the requested range and the end of the segment.
+        size_t slack;
+    };
+
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+    static constexpr size_t TagSize = sizeof(Tag);
+    // Also the smallest free segment: its size word and the trailing copy of it.
+    static constexpr size_t Granularity = 16u;
+
+    static constexpr size_t Used = 1u;
+    static constexpr size_t PrevUsed = 2u;
+    static constexpr size_t FlagsMask = Granularity - 1u;
+
+    // Pages of a released range go back to the system once it is part of a free segment this large.
+    static constexpr size_t DiscardSize = 64u * 1024u;
+    // Queued releases are sorted and merged this many at a time.
+    static constexpr size_t RemoteBatch = 64u;
+
+    using Slabs = SlabPool<SlabSize>;
+
+    // Guards the other members. Taken by the owner, never by the block itself.
+    std::mutex mutex;
+    const size_t capacity;
+    Manager manager;
+    Slabs slabs;
+    PageBuffer pool;
+    BlockCounters counters;
+    // Set while the block is retired: it holds nothing and its pages went back to the system.
+    bool dormant = false;
+    // When the last allocation of the block was released.
+    std::chrono::steady_clock::time_point idleSince = std::chrono::steady_clock::now();
+    // Whole allocations released without the lock, linked through their first word. Any thread
+    // may push; whoever holds the lock takes the whole list at once, so there is no ABA.
+    std::atomic<Byte *> remoteFrees{nullptr};
+
+    explicit MemoryBlock(size_t blockSize)
+        : capacity{capacityFor(blockSize)}, slabs(capacity), pool(capacity, HugePages)
+    {
+        manager = _newManager();
+        _writeFree(0u, capacity, true);
+        _addFree({0u, capacity});
+    }
+
+    // The pool carries one tag on top of the block size, so a single request can still take all of it.
+    static size_t capacityFor(size_t blockSize)
+    {
+        return _alignUp(blockSize, Granularity) + TagSize;
+    }
+
+    // Size of the tagged segment a request of `byteSize` bytes takes, before any alignment padding.
+    static size_t segmentSize(size_t byteSize)
+    {
+        return std::max(_alignUp(byteSize + TagSize, Granularity), 2u * Granularity);
+    }
+
+    // Largest request a free segment of `size` bytes, or a fresh pool of that capacity, can hold.
+    static size_t roomIn(size_t size)
+    {
+        return (size > TagSize) ? size - TagSize : 0u;
+    }
+
+    MemoryBlock(const MemoryBlock &other) = delete;
+    MemoryBlock &operator=(const MemoryBlock &other) = delete;
+    MemoryBlock(MemoryBlock &&rr) = delete;
+    MemoryBlock &operator=(MemoryBlock &&rr) = delete;
+
+    // Takes a tagged segment holding `byteSize` bytes at an address that is a multiple of
+    // `alignment` out of the free segment the manager fits it into. Returns nullptr if none is large enough.
+    Byte *allocate(size_t byteSize, size_t alignment = Granularity)
+    {
+        const size_t size = segmentSize(byteSize);
+
+        SegmentBase segment;
+        size_t head;
+
+        if (!_fit(size, alignment, segment, head))
+        {
+            return nullptr;
+        }
+
+        _deleteFree(segment);
+
+        const bool prevUsed = (_tag(segment.head).sizeAndFlags & PrevUsed) != 0u;
+        const size_t end = segment.head + segment.size;
+
+        if (head != segment.head)
+        {
+            _writeFree(segment.head, head - segment.head, prevUsed);
+            _addFree({segment.head, head - segment.head});
+        }
+
+        _writeUsed(head, size, head == segment.head && prevUsed, size - TagSize - byteSize);
+
+        if (head + size != end)
+        {
+            _writeFree(head + size, end - head - size, true);
+            _addFree({head + size, end - head - size});
+        }
+        else if (end != capacity)
+        {
+            _tag(end).sizeAndFlags |= PrevUsed;
+        }
+
+        return &pool[head + TagSize];
+    }
+
+    // Releases the segment `ptr` points into, merging it with the free segments it touches.
+    // A non-zero byte count smaller than the requested range releases only its head and returns
+    // the pointer to the part that stays allocated. Throws std::bad_alloc on a segment that is not in use.
+    Byte *deallocate(Byte *ptr, size_t count)
+    {
+        const size_t offset = ptr - pool.data();
+
+        if (offset < TagSize)
+        {
+            throw std::bad_alloc();
+        }
+
+        const size_t head = _alignDown(offset, Granularity) - TagSize;
+        const Tag tag = _tag(head);
+
+        if ((tag.sizeAndFlags & Used) == 0u)
+        {
+            throw std::bad_alloc();
+        }
+
+        const size_t end = head + (tag.sizeAndFlags & ~FlagsMask);
+        const size_t requested = end - tag.slack - offset;
+        const bool prevUsed = (tag.sizeAndFlags & PrevUsed) != 0u;
+
+        if (count > requested)
+        {
+            throw std::bad_alloc();
+        }
+
+        if (count == 0u || count == requested)
+        {
+            _release(head, end - head, prevUsed);
+            return nullptr;
+        }
+
+        const size_t remainderHead = _alignDown(offset + count, Granularity) - TagSize;
+
+        // Otherwise the remainder still resolves to this tag and the head stays with it.
+        if (remainderHead != head)
+        {
+            _writeUsed(remainderHead, end - remainderHead, false, tag.slack);
+            _release(head, remainderHead - head, prevUsed);
+        }
+
+        return ptr + count;
+    }
+
+    // Changes the requested range of the segment `ptr` points into to `byteSize` bytes from `ptr`
+    // without moving it. Shrinking returns the tail to the free segments; growing takes the room
+    // it needs from the free segment that follows. Returns false if that segment is too small.
+    bool resize(Byte *ptr, size_t byteSize)
+    {
+        const size_t offset = ptr - pool.data();
+
+        // Slab objects record no requested size, so one of another class could not be released.
+        if (ownsSmall(ptr))
+        {
+            return Slabs::fits(byteSize) && Slabs::classSize(byteSize) == slabs.objectSize(pool.data(), offset) &&
+                   byteSize <= slabs.roomAt(pool.data(), offset);
+        }
+
+        if (offset < TagSize)
+        {
+            throw std::bad_alloc();
+        }
+
+        const size_t head = _alignDown(offset, Granularity) - TagSize;
+        const size_t flags = _tag(head).sizeAndFlags & FlagsMask;
+
+        if ((flags & Used) == 0u)
+        {
+            throw std::bad_alloc();
+        }
+
+        const size_t end = head + (_tag(head).sizeAndFlags & ~FlagsMask);
+        const size_t newEnd = std::max(_alignUp(offset + byteSize, Granularity), head + 2u * Granularity);
+
+        if (newEnd < end)
+        {
+            _release(newEnd, end - newEnd, true);
+        }
+        else if (newEnd > end)
+        {
+            if (end == capacity || (_tag(end).sizeAndFlags & Used) != 0u)
+            {
+                return false;
+            }
+
+            const size_t rightSize = _tag(end).sizeAndFlags & ~FlagsMask;
+            const size_t rightEnd = end + rightSize;
+
+            if (rightEnd < newEnd)
+            {
+                return false;
+            }
+
+            _deleteFree({end, rightSize});
+
+            if (rightEnd != newEnd)
+            {
+                _writeFree(newEnd, rightEnd - newEnd, true);
+                _addFree({newEnd, rightEnd - newEnd});
+            }
+            else if (rightEnd != capacity)
+            {
+                _tag(rightEnd).sizeAndFlags |= PrevUsed;
+            }
+        }
+
+        _tag(head) = Tag{(newEnd - head) | flags, newEnd - offset - byteSize};
+        return true;
+    }
+
+    // Releases whole allocations given in ascending address order. Neighbouring segments are
+    // merged before the manager sees them, so a run of them costs one update instead of one
+    // per segment. Throws std::bad_alloc on a segment that is not in use.
+    template <typename T>
+    void deallocateBulk(T *const *ptrs, size_t count)
+    {
+        size_t runHead = 0u;
+        size_t runEnd = 0u;
+
+        for (size_t i = 0u; i < count; ++i)
+        {
+            Byte *ptr = reinterpret_cast<Byte *>(ptrs[i]);
+
+            if (ownsSmall(ptr))
+            {
+                if (!deallocateSmall(ptr - pool.data()))
+                {
+                    _releaseRun(runHead, runEnd);
+                    throw std::bad_alloc();
+                }
+                continue;
+            }
+
+            const size_t offset = ptr - pool.data();
+            const size_t head = (offset < TagSize) ? npos : _alignDown(offset, Granularity) - TagSize;
+
+            // A pointer into the pending run is released twice.
+            if (head == npos || (head >= runHead && head < runEnd) || (_tag(head).sizeAndFlags & Used) == 0u)
+            {
+                _releaseRun(runHead, runEnd);
+                throw std::bad_alloc();
+            }
+
+            if (head != runEnd)
+            {
+                _releaseRun(runHead, runEnd);
+                runHead = head;
+            }
+
+            runEnd = head + (_tag(head).sizeAndFlags & ~FlagsMask);
+        }
+
+        _releaseRun(runHead, runEnd);
+    }
+
+    // Queues a whole allocation for release by the next holder of the lock. Lock-free.
+    void pushRemote(Byte *ptr)
+    {
+        Byte *head = remoteFrees.load(std::memory_order_relaxed);
+
+        do
+        {
+            std::memcpy(ptr, &head, sizeof(head));
+        } while (!remoteFrees.compare_exchange_weak(head, ptr, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Expects the lock to be held. Releases everything pushRemote() queued, in sorted batches so
+    // neighbours merge. Returns how many allocations were released.
+    size_t drainRemote()
+    {
+        Byte *ptr = remoteFrees.exchange(nullptr, std::memory_order_acquire);
+        size_t drained = 0u;
+
+        while (ptr != nullptr)
+        {
+            Byte *batch[RemoteBatch];
+            size_t count = 0u;
+
+            for (; ptr != nullptr && count < RemoteBatch; ++count)
+            {
+                batch[count] = ptr;
+                std::memcpy(&ptr, ptr, sizeof(ptr));
+            }
+
+            std::sort(batch, batch + count, std::less<Byte *>());
+            deallocateBulk(batch, count);
+            drained += count;
+        }
+
+        return drained;
+    }
+
+    Byte *allocateSmall(size_t byteSize)
+    {
+        return slabs.allocate(pool.data(), byteSize, [this]() -> size_t {
+            Byte *slab = allocate(SlabSize, SlabSize);
+            return (slab == nullptr) ? Slabs::npos : slab - pool.data();
+        });
+    }
+
+    bool deallocateSmall(size_t offset)
+    {
+        return slabs.deallocate(pool.data(), offset, [this](size_t slab) -> void { deallocate(&pool[slab], 0u); });
+    }
+
+    bool contains(const Byte *ptr) const
+    {
+        return ptr >= pool.data() && ptr < pool.data() + capacity;
+    }
+
+    bool ownsSmall(const Byte *ptr) const
+    {
+        return slabs.owns(pool.data(), ptr - pool.data());
+    }
+
+    // Counts a request served by this block. Expects the block's mutex to be held.
+    void countAllocation(size_t byteSize)
+    {
+        BlockCounters::add(counters.allocations, uint64_t{1u});
+        BlockCounters::add(counters.histogram[histogramBin(byteSize)], uint64_t{1u});
+        updatePeak();
+    }
+
+    // Raises the peak to the bytes in use now. Expects the block's mutex to be held.
+    void updatePeak()
+    {
+        const size_t used = capacity - counters.freeBytes.load(std::memory_order_relaxed);
+
+        if (used > counters.peakUsedBytes.load(std::memory_order_relaxed))
+        {
+            counters.peakUsedBytes.store(used, std::memory_order_relaxed);
+        }
+    }
+
+    // Counter snapshot, safe to take without the lock. The largest free segment is left to the
+    // owner, which has to lock the block to read it from the manager.
+    BlockStats stats() const
+    {
+        BlockStats stats;
+
+        stats.capacity = capacity;
+        stats.freeBytes = counters.freeBytes.load(std::memory_order_relaxed);
+        stats.usedBytes = capacity - stats.freeBytes;
+        stats.peakUsedBytes = counters.peakUsedBytes.load(std::memory_order_relaxed);
+        stats.freeSegments = counters.freeSegments.load(std::memory_order_relaxed);
+        stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+        stats.deallocations = counters.deallocations.load(std::memory_order_relaxed);
+
+        return stats;
+    }
+
+    size_t liveAllocations() const
+    {
+        return counters.allocations.load(std::memory_order_relaxed) - counters.deallocations.load(std::memory_order_relaxed);
+    }
+
+    // Returns the block to its initial state and every page of it to the system. Only valid
+    // while it holds no allocation; cached empty slabs are dropped.
+    void reset()
+    {
+        manager = _newManager();
+        slabs = Slabs(capacity);
+        counters.freeBytes.store(0u, std::memory_order_relaxed);
+        counters.freeSegments.store(0u, std::memory_order_relaxed);
+
+        pool.discard(0u, capacity);
+        _writeFree(0u, capacity, true);
+        _addFree({0u, capacity});
+    }
+
+    // Expects the lock to be held.
+    size_t largestFreeSegment()
+    {
+        return manager.maxSizeSegment();
+    }
+
+    // Largest request a single allocate() call can currently satisfy.
+    size_t maxAllocation()
+    {
+        return roomIn(largestFreeSegment());
+    }
+
+  private:
+    // Managers that keep their records in the free segments get the bytes between the size word
+    // of a free segment and its trailing copy. Only segments of at least two granules have any.
+    Manager _newManager()
+    {
+        if constexpr (std::is_constructible<Manager, Byte *>::value)
+        {
+            static_assert(Granularity % Manager::HeadUnit == 0u && Manager::MinSegment <= 2u * Granularity &&
+                              offsetof(Tag, slack) + Manager::RecordSize + sizeof(size_t) <= Manager::MinSegment,
+                          "every segment the manager tracks must have room for its record");
+            return Manager(pool.data() + offsetof(Tag, slack));
+        }
+        else
+        {
+            return Manager();
+        }
+    }
+
+    static size_t _alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1u) / alignment * alignment;
+    }
+
+    static size_t _alignDown(size_t value, size_t alignment)
+    {
+        return value / alignment * alignment;
+    }
+
+    // Finds a free segment that holds `size` bytes with its payload at a multiple of `alignment`.
+    // Leading padding stays behind as a free segment of its own.
+    bool _fit(size_t size, size_t alignment, SegmentBase &segment, size_t &head)
+    {
+        if (manager.fitSegment({0u, size}, segment) && _place(segment, size, alignment, head))
+        {
+            return true;
+        }
+
+        return alignment > Granularity && manager.fitSegment({0u, size + alignment}, segment) &&
+               _place(segment, size, alignment, head);
+    }
+
+    bool _place(const SegmentBase &segment, size_t size, size_t alignment, size_t &head) const
+    {
+        const uintptr_t base = reinterpret_cast<uintptr_t>(pool.data());
+
+        head = _alignUp(base + segment.head + TagSize, alignment) - TagSize - base;
+
+        return head + size <= segment.head + segment.size;
+    }
+
+    // Slab releases in between may have freed the segment in front of the run, so its flags are read last.
+    void _releaseRun(size_t head, size_t end)
+    {
+        if (head != end)
+        {
+            _release(head, end - head, (_tag(head).sizeAndFlags & PrevUsed) != 0u);
+        }
+    }
+
+    void _release(size_t head, size_t size, bool prevUsed)
+    {
+        const size_t releasedHead = head;
+        const size_t releasedEnd = head + size;
+
+        // Clearing the used bit first lets a repeated release of the same pointer be detected.
+        _tag(head).sizeAndFlags = size | (prevUsed ? PrevUsed : 0u);
+
+        if (head + size != capacity && (_tag(head + size).sizeAndFlags & Used) == 0u)
+        {
+            const size_t rightSize = _tag(head + size).sizeAndFlags & ~FlagsMask;
+
+            _deleteFree({head + size, rightSize});
+            size += rightSize;
+        }
+
+        if (!prevUsed)
+        {
+            const size_t leftSize = _footer(head);
+
+            head -= leftSize;
+            size += leftSize;
+            prevUsed = (_tag(head).sizeAndFlags & PrevUsed) != 0u;
+
+            _deleteFree({head, leftSize});
+        }
+
+        if (size >= DiscardSize)
+        {
+            // Only the newly released range is advised, so merging into a large free segment
+            // does not hand the same pages back over and over.
+            const size_t begin = std::max(releasedHead, head + TagSize);
+            const size_t end = std::min(releasedEnd, head + size - sizeof(size));
+
+            if (begin < end)
+            {
+                pool.discard(begin, end - begin);
+            }
+        }
+
+        _writeFree(head, size, prevUsed);
+
+        if (head + size != capacity)
+        {
+            _tag(head + size).sizeAndFlags &= ~PrevUsed;
+        }
+
+        _addFree({head, size});
+    }
+
+    void _addFree(const SegmentBase &segment)
+    {
+        manager.addSegment(segment);
+        BlockCounters::add(counters.freeBytes, segment.size);
+        BlockCounters::add(counters.freeSegments, size_t{1u});
+    }
+
+    void _deleteFree(const SegmentBase &segment)
+    {
+        manager.deleteSegment(segment);
+        BlockCounters::sub(counters.freeBytes, segment.size);
+        BlockCounters::sub(counters.freeSegments, size_t{1u});
+    }
+
+    Tag &_tag(size_t head)
+    {
+        return *std::launder(reinterpret_cast<Tag *>(&pool[head]));
+    }
+
+    // Size of the free segment that ends at `end`.
+    size_t _footer(size_t end) const
+    {
+        size_t size;
+        std::memcpy(&size, &pool[end - sizeof(size)], sizeof(size));
+        return size;
+    }
+
+    void _writeUsed(size_t head, size_t size, bool prevUsed, size_t slack)
+    {
+        new (&pool[head]) Tag{size | Used | (prevUsed ? PrevUsed : 0u), slack};
+    }
+
+    void _writeFree(size_t head, size_t size, bool prevUsed)
+    {
+        new (&pool[head]) Tag{size | (prevUsed ? PrevUsed : 0u), 0u};
+        std::memcpy(&pool[head + size - sizeof(size)], &size, sizeof(size));
+    }
+};
+
+} // namespace Utility
+} // namespace Yaro
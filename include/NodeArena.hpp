@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace Yaro
+{
+namespace Utility
+{
+
+// Hands out nodes from chunks that grow geometrically and keeps released nodes on an
+// intrusive free list, so a warmed up tree never goes back to the system heap.
+template <typename Node, size_t MinChunkSize = 64u, size_t MaxChunkSize = 65536u>
+class NodeArena
+{
+    union Slot
+    {
+        Slot *next;
+        alignas(Node) unsigned char storage[sizeof(Node)];
+    };
+
+  public:
+    NodeArena() = default;
+
+    NodeArena(const NodeArena &other) = delete;
+    NodeArena &operator=(const NodeArena &other) = delete;
+
+    NodeArena(NodeArena &&rr)
+        : m_chunks{std::move(rr.m_chunks)}, m_free{rr.m_free}, m_capacity{rr.m_capacity}
+    {
+        rr.m_free = nullptr;
+        rr.m_capacity = 0u;
+    }
+
+    NodeArena &operator=(NodeArena &&rr)
+    {
+        m_chunks = std::move(rr.m_chunks);
+        m_free = rr.m_free;
+        m_capacity = rr.m_capacity;
+
+        rr.m_free = nullptr;
+        rr.m_capacity = 0u;
+        return *this;
+    }
+
+    template <typename... Args>
+    Node *create(Args &&...args)
+    {
+        if (m_free == nullptr)
+        {
+            _grow();
+        }
+
+        Slot *slot = m_free;
+        m_free = slot->next;
+
+        return new (slot->storage) Node{std::forward<Args>(args)...};
+    }
+
+    void destroy(Node *node)
+    {
+        node->~Node();
+
+        Slot *slot = reinterpret_cast<Slot *>(node);
+        slot->next = m_free;
+        m_free = slot;
+    }
+
+    // Drops every chunk at once. Nodes still alive are not destroyed.
+    void clear()
+    {
+        m_chunks.clear();
+        m_free = nullptr;
+        m_capacity = 0u;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+  private:
+    void _grow()
+    {
+        const size_t chunkSize = std::min(MaxChunkSize, std::max(MinChunkSize, m_capacity));
+        Slot *chunk = new Slot[chunkSize];
+
+        m_chunks.emplace_back(chunk);
+
+        for (size_t i = chunkSize; i-- > 0u;)
+        {
+            chunk[i].next = m_free;
+            m_free = &chunk[i];
+        }
+
+        m_capacity += chunkSize;
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> m_chunks;
+    Slot *m_free = nullptr;
+    size_t m_capacity = 0u;
+};
+
+} // namespace Utility
+} // namespace Yaro
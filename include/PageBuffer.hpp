@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Yaro
+{
+namespace Utility
+{
+
+using Byte = unsigned char;
+
+// Fixed-size byte buffer taken straight from reserved virtual memory. Pages are committed by the
+// system on first touch and can be handed back with discard(), so a buffer costs no resident
+// memory until it is written. The contents of fresh or discarded pages read as zero.
+//
+// A buffer asked for huge pages first tries explicit ones (MAP_HUGETLB), then a HugePageSize
+// aligned mapping marked with MADV_HUGEPAGE, and silently keeps normal pages where neither exists.
+class PageBuffer
+{
+  public:
+    static constexpr size_t HugePageSize = size_t{2u} << 20;
+
+    explicit PageBuffer(size_t size, bool hugePages = false)
+        : m_size{size}, m_mappedSize{size}, m_discardSize{pageSize()}
+    {
+#if defined(_WIN32)
+        // Large pages need a privilege a process rarely holds, so they are not attempted.
+        (void)hugePages;
+        m_data = static_cast<Byte *>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+        if (hugePages)
+        {
+            m_mappedSize = (size + HugePageSize - 1u) / HugePageSize * HugePageSize;
+            m_discardSize = HugePageSize;
+            m_data = _mapHugeTlb(m_mappedSize);
+
+            if (m_data == nullptr)
+            {
+                m_data = _mapTransparentHuge(m_mappedSize);
+            }
+        }
+        else
+        {
+            m_data = _map(m_mappedSize);
+        }
+#endif
+
+        if (m_data == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    PageBuffer(const PageBuffer &other) = delete;
+    PageBuffer &operator=(const PageBuffer &other) = delete;
+
+    ~PageBuffer()
+    {
+#if defined(_WIN32)
+        VirtualFree(m_data, 0, MEM_RELEASE);
+#else
+        munmap(m_data, m_mappedSize);
+#endif
+    }
+
+    static size_t pageSize()
+    {
+#if defined(_WIN32)
+        static const size_t size = [] {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return static_cast<size_t>(info.dwPageSize);
+        }();
+#else
+        static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        return size;
+    }
+
+    // Returns the whole pages inside [offset, offset + length) to the system. Huge page buffers
+    // only give back whole huge pages, so discarding never splits one.
+    void discard(size_t offset, size_t length)
+    {
+        const uintptr_t page = m_discardSize;
+        const uintptr_t begin = (reinterpret_cast<uintptr_t>(m_data + offset) + page - 1u) / page * page;
+        const uintptr_t end = reinterpret_cast<uintptr_t>(m_data + offset + length) / page * page;
+
+        if (begin >= end)
+        {
+            return;
+        }
+
+#if defined(_WIN32)
+        // MEM_RESET keeps the old contents around, so decommit instead and commit again: pages
+        // committed afresh are zero-filled on first touch, like MADV_DONTNEED ones.
+        VirtualFree(reinterpret_cast<void *>(begin), end - begin, MEM_DECOMMIT);
+
+        if (VirtualAlloc(reinterpret_cast<void *>(begin), end - begin, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+#else
+        madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+#endif
+    }
+
+    Byte *data()
+    {
+        return m_data;
+    }
+
+    const Byte *data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    Byte &operator[](size_t offset)
+    {
+        return m_data[offset];
+    }
+
+    const Byte &operator[](size_t offset) const
+    {
+        return m_data[offset];
+    }
+
+  private:
+#if !defined(_WIN32)
+    static Byte *_map(size_t size)
+    {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+        flags |= MAP_NORESERVE;
+#endif
+        void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+        return (data == MAP_FAILED) ? nullptr : static_cast<Byte *>(data);
+    }
+
+    // Explicit huge pages are reserved up front: without a reservation a fault on an exhausted
+    // huge page pool is a SIGBUS rather than a failed mmap.
+    static Byte *_mapHugeTlb(size_t size)
+    {
+#ifdef MAP_HUGETLB
+        void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        return (data == MAP_FAILED) ? nullptr : static_cast<Byte *>(data);
+#else
+        return nullptr;
+#endif
+    }
+
+    // Over-reserves by one huge page and trims both ends so the mapping starts on a huge page
+    // boundary, which transparent huge pages need to back it.
+    static Byte *_mapTransparentHuge(size_t size)
+    {
+        Byte *reserved = _map(size + HugePageSize);
+
+        if (reserved == nullptr)
+        {
+            return nullptr;
+        }
+
+        const uintptr_t address = reinterpret_cast<uintptr_t>(reserved);
+        const size_t lead = (HugePageSize - address % HugePageSize) % HugePageSize;
+        Byte *data = reserved + lead;
+
+        if (lead != 0u)
+        {
+            munmap(reserved, lead);
+        }
+        munmap(data + size, HugePageSize - lead);
+
+#ifdef MADV_HUGEPAGE
+        madvise(data, size, MADV_HUGEPAGE);
+#endif
+        return data;
+    }
+#endif
+
+    Byte *m_data;
+    size_t m_size;
+    size_t m_mappedSize;
+    size_t m_discardSize;
+};
+
+} // namespace Utility
+} // namespace Yaro
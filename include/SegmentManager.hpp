@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+
+#include "AVLTree.hpp"
+#include "BPlusTree.hpp"
+
+namespace Yaro
+{
+namespace Utility
+{
+
+template <typename KeyType>
+using CompactAVLTree = AVLTree<KeyType, CompactNodes>;
+
+// Segment types shared by every ordered index the segment manager can keep them in.
+struct SegmentManagerBase
+{
+    struct SegmentBase
+    {
+        size_t head;
+        size_t size;
+
+        SegmentBase()
+            : SegmentBase{0u, 0u}
+        {
+        }
+
+        SegmentBase(size_t head, size_t size)
+        {
+            this->head = head;
+            this->size = size;
+        }
+
+        bool operator==(const SegmentBase &other)
+        {
+            return head == other.head && size == other.size;
+        }
+    };
+
+    struct HeadHeavy : public SegmentBase
+    {
+        size_t compareBy() const
+        {
+            return head;
+        }
+        void setCompared(size_t val)
+        {
+            head = val;
+        }
+        size_t tieBreak() const
+        {
+            return size;
+        }
+    };
+
+    struct SizeHeavy : public SegmentBase
+    {
+        size_t compareBy() const
+        {
+            return size;
+        }
+        void setCompared(size_t val)
+        {
+            size = val;
+        }
+        // Free segments of equal size are distinct keys, ordered by address.
+        size_t tieBreak() const
+        {
+            return head;
+        }
+    };
+
+    template <typename ComparisonStrategy>
+    struct Segment : public ComparisonStrategy
+    {
+        bool operator==(const Segment &other) const noexcept
+        {
+            return _key() == other._key();
+        }
+        bool operator!=(const Segment &other) const noexcept
+        {
+            return _key() != other._key();
+        }
+
+        bool operator<(const Segment &other) const noexcept
+        {
+            return _key() < other._key();
+        }
+        bool operator>(const Segment &other) const noexcept
+        {
+            return _key() > other._key();
+        }
+
+        bool operator<=(const Segment &other) const noexcept
+        {
+            return _key() <= other._key();
+        }
+        bool operator>=(const Segment &other) const noexcept
+        {
+            return _key() >= other._key();
+        }
+
+        Segment operator-(const Segment &other) const noexcept
+        {
+            Segment segment{other};
+            auto cmp = std::max(ComparisonStrategy::compareBy(), other.ComparisonStrategy::compareBy()) -
+                       std::min(ComparisonStrategy::compareBy(), other.ComparisonStrategy::compareBy());
+            segment.ComparisonStrategy::setCompared(cmp);
+
+            return segment;
+        }
+
+        static Segment abs(Segment val)
+        {
+            return val;
+        }
+
+        static Segment max()
+        {
+            Segment dummy;
+            dummy.ComparisonStrategy::setCompared(std::numeric_limits<size_t>::max());
+            return dummy;
+        }
+
+        Segment()
+            : Segment(0u, 0u){};
+
+        Segment(const SegmentBase &segment)
+            : Segment(segment.head, segment.size)
+        {
+        }
+
+        Segment(size_t head, size_t size)
+        {
+            this->head = head;
+            this->size = size;
+        }
+
+        Segment(const Segment &other)
+        {
+            this->head = other.head;
+            this->size = other.size;
+        }
+
+        Segment &operator=(const Segment &other)
+        {
+            this->head = other.head;
+            this->size = other.size;
+            return *this;
+        }
+
+        Segment(Segment &&rr)
+        {
+            this->head = rr.head;
+            this->size = rr.size;
+        }
+
+        Segment &operator=(Segment &&rr)
+        {
+            this->head = rr.head;
+            this->size = rr.size;
+            return *this;
+        }
+
+      private:
+        std::pair<size_t, size_t> _key() const noexcept
+        {
+            return {ComparisonStrategy::compareBy(), ComparisonStrategy::tieBreak()};
+        }
+    };
+};
+
+// Placement strategies for BasicSegmentManager::fitSegment(). The manager holds one, so a
+// strategy may keep state from one fit to the next.
+
+// Smallest segment that fits, the lowest addressed among equals. Keeps large segments whole.
+struct BestFit
+{
+    template <typename Manager>
+    bool fit(Manager &manager, const SegmentManagerBase::SegmentBase &segment, SegmentManagerBase::SegmentBase &outSegment)
+    {
+        return manager.bestFitSegment(segment, outSegment);
+    }
+};
+
+// Lowest addressed segment that fits, which packs allocations towards the start of the block.
+// Walks the segments in address order once, so it slows down behind many segments too small to fit.
+struct FirstFit
+{
+    template <typename Manager>
+    bool fit(Manager &manager, const SegmentManagerBase::SegmentBase &segment, SegmentManagerBase::SegmentBase &outSegment)
+    {
+        return manager.firstFitSegment(segment, outSegment);
+    }
+};
+
+// First fit from where the previous fit ended, wrapping around once. Small segments left
+// behind are not walked over again until the search wraps.
+struct NextFit
+{
+    template <typename Manager>
+    bool fit(Manager &manager, const SegmentManagerBase::SegmentBase &segment, SegmentManagerBase::SegmentBase &outSegment)
+    {
+        if (!manager.firstFitSegment(segment, outSegment, m_rover) && !manager.firstFitSegment(segment, outSegment))
+        {
+            return false;
+        }
+
+        m_rover = outSegment.head + segment.size;
+        return true;
+    }
+
+  private:
+    size_t m_rover = 0u;
+};
+
+// Largest segment, so that what is left of it stays usable for large requests.
+struct WorstFit
+{
+    template <typename Manager>
+    bool fit(Manager &manager, const SegmentManagerBase::SegmentBase &segment, SegmentManagerBase::SegmentBase &outSegment)
+    {
+        return manager.worstFitSegment(segment, outSegment);
+    }
+};
+
+// Keeps free segments in two ordered sets, one by size for fitting and one by address for
+// finding neighbours. `OrderedIndex` is AVLTree or BPlusTree, or anything with their lookups;
+// `FitPolicy` picks the segment a request is placed in.
+template <template <typename> class OrderedIndex, typename FitPolicy = BestFit>
+class BasicSegmentManager : public SegmentManagerBase
+{
+  public:
+    void addSegment(const SegmentBase &segment)
+    {
+        m_sizeHeavySegments.insert(segment);
+        m_headHeavySegments.insert(segment);
+    }
+
+    bool deleteSegment(const SegmentBase &segment)
+    {
+        return m_headHeavySegments.pop(segment) && m_sizeHeavySegments.pop(segment);
+    }
+
+    bool bestFitSegment(const SegmentBase &segment, SegmentBase &outSegment)
+    {
+        // Below every segment of the requested size, so the lowest addressed of them is found.
+        Segment<SizeHeavy> found;
+        return _found(m_sizeHeavySegments.findClosestGreaterEqual(Segment<SizeHeavy>(0u, segment.size), found), found,
+                      outSegment);
+    }
+
+    // Lowest addressed segment of at least `segment.size` bytes that starts at `from` or later.
+    bool firstFitSegment(const SegmentBase &segment, SegmentBase &outSegment, size_t from = 0u)
+    {
+        if (maxSizeSegment() < segment.size)
+        {
+            return false;
+        }
+
+        const size_t size = segment.size;
+        const auto fits = [size](const SegmentBase &candidate) { return candidate.size >= size; };
+
+        Segment<HeadHeavy> found;
+        return _found(m_headHeavySegments.findFirstGreaterEqual(Segment<HeadHeavy>(from, 0u), fits, found), found,
+                      outSegment);
+    }
+
+    // Largest segment, if it holds `segment.size` bytes.
+    bool worstFitSegment(const SegmentBase &segment, SegmentBase &outSegment)
+    {
+        Segment<SizeHeavy> found;
+        return _found(m_sizeHeavySegments.findMax(found) && found.size >= segment.size, found, outSegment);
+    }
+
+    // Search MemoryBlock places requests with.
+    bool fitSegment(const SegmentBase &segment, SegmentBase &outSegment)
+    {
+        return m_fitPolicy.fit(*this, segment, outSegment);
+    }
+
+    bool getLeftAdjacentSegment(const SegmentBase &segment, SegmentBase &outSegment)
+    {
+        Segment<HeadHeavy> found;
+        return _found(m_headHeavySegments.findClosestLesser(segment, found), found, outSegment);
+    }
+
+    bool getRightAdjacentSegment(const SegmentBase &segment, SegmentBase &outSegment)
+    {
+        Segment<HeadHeavy> found;
+        return _found(m_headHeavySegments.findClosestGreater(segment, found), found, outSegment);
+    }
+
+    size_t maxSizeSegment()
+    {
+        Segment<SizeHeavy> found;
+
+        if (m_sizeHeavySegments.findMax(found))
+        {
+            return found.size;
+        }
+
+        return 0u;
+    }
+
+  private:
+    // Tree lookups report through the full key type, never through a downcast SegmentBase.
+    static bool _found(bool found, const SegmentBase &result, SegmentBase &outSegment)
+    {
+        if (found)
+        {
+            outSegment = {result.head, result.size};
+        }
+
+        return found;
+    }
+
+    OrderedIndex<Segment<HeadHeavy>> m_headHeavySegments;
+    OrderedIndex<Segment<SizeHeavy>> m_sizeHeavySegments;
+    FitPolicy m_fitPolicy;
+};
+
+using SegmentManager = BasicSegmentManager<CompactAVLTree>;
+using BTreeSegmentManager = BasicSegmentManager<BPlusTree>;
+
+} // namespace Utility
+} // namespace Yaro
@@ -1,20 +0,0 @@
-#pragma once
-
-#include <memory>
-
-namespace Yaro
-{
-namespace Utility
-{
-
-template <typename Derived>
-class Shared
-{
-  public:
-    Shared() = default;
-    virtual ~Shared() = default;
-    using Ptr = std::shared_ptr<Derived>;
-};
-
-} // namespace Utility
-} // namespace Yaro
\ No newline at end of file
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <vector>
+
+#include "BitScan.hpp"
+
+namespace Yaro
+{
+namespace Utility
+{
+
+using Byte = unsigned char;
+
+// Fixed size classes for small requests. Every slab is a SlabSize-aligned region of a block
+// that holds objects of one class and tracks them with a free bitmap stored at its start.
+// Slabs are aligned by address, so the pool itself needs no particular alignment.
+template <size_t SlabSize = 4096u>
+class SlabPool
+{
+    static_assert(SlabSize != 0u && (SlabSize & (SlabSize - 1u)) == 0u, "slab size must be a power of two");
+
+  public:
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+    static constexpr std::array<size_t, 6u> SizeClasses = {8u, 16u, 24u, 32u, 48u, 64u};
+    static constexpr size_t MaxSize = SizeClasses.back();
+
+    static bool fits(size_t byteSize)
+    {
+        return byteSize != 0u && byteSize <= MaxSize;
+    }
+
+    static size_t classSize(size_t byteSize)
+    {
+        return SizeClasses[_classIndex(byteSize)];
+    }
+
+    // Alignment every object of the class serving `byteSize` is guaranteed to have.
+    static size_t classAlignment(size_t byteSize)
+    {
+        const size_t size = classSize(byteSize);
+        return std::min(size & (~size + 1u), SlotsOffset & (~SlotsOffset + 1u));
+    }
+
+    bool owns(const Byte *pool, size_t offset) const
+    {
+        return m_regions[_region(pool, offset)];
+    }
+
+    // `carveSlab()` returns the offset of a fresh SlabSize-aligned region, or npos.
+    // Returns nullptr when every slab of the class is full and no region can be carved.
+    template <typename CarveSlab>
+    Byte *allocate(Byte *pool, size_t byteSize, CarveSlab &&carveSlab)
+    {
+        const size_t sizeClass = _classIndex(byteSize);
+        size_t slab = m_partial[sizeClass];
+
+        if (slab == npos)
+        {
+            slab = carveSlab();
+
+            if (slab == npos)
+            {
+                return nullptr;
+            }
+
+            _initialise(pool, slab, sizeClass);
+        }
+
+        Header &header = _header(pool, slab);
+
+        size_t word = 0u;
+        while (header.bitmap[word] == 0u)
+        {
+            ++word;
+        }
+
+        const size_t slot = word * 64u + lowestSetBit(header.bitmap[word]);
+        header.bitmap[word] &= header.bitmap[word] - 1u;
+
+        if (--header.freeCount == 0u)
+        {
+            _unlink(pool, slab);
+        }
+
+        return pool + slab + SlotsOffset + slot * SizeClasses[sizeClass];
+    }
+
+    size_t objectSize(Byte *pool, size_t offset) const
+    {
+        return SizeClasses[_header(pool, _slabOf(pool, offset)).sizeClass];
+    }
+
+    // Bytes from `offset` to the end of the object containing it.
+    size_t roomAt(Byte *pool, size_t offset) const
+    {
+        const size_t slab = _slabOf(pool, offset);
+        const size_t size = objectSize(pool, offset);
+
+        return size - (offset - slab - SlotsOffset) % size;
+    }
+
+    // Releases the object containing `offset`; returns false if its slot is not allocated.
+    // `releaseSlab(offset)` takes back a slab that became empty while others of its class have room.
+    template <typename ReleaseSlab>
+    bool deallocate(Byte *pool, size_t offset, ReleaseSlab &&releaseSlab)
+    {
+        const size_t slab = _slabOf(pool, offset);
+        Header &header = _header(pool, slab);
+        const size_t objectSize = SizeClasses[header.sizeClass];
+
+        const size_t slot = (offset - slab - SlotsOffset) / objectSize;
+        uint64_t &word = header.bitmap[slot / 64u];
+        const uint64_t bit = uint64_t{1u} << (slot % 64u);
+
+        if ((word & bit) != 0u)
+        {
+            return false;
+        }
+
+        word |= bit;
+
+        if (header.freeCount++ == 0u)
+        {
+            _pushFront(pool, slab);
+        }
+
+        if (header.freeCount == _capacity(header.sizeClass) && (header.prev != npos || header.next != npos))
+        {
+            _unlink(pool, slab);
+            m_regions[_region(pool, slab)] = false;
+            releaseSlab(slab);
+        }
+
+        return true;
+    }
+
+    // `capacity` is the size of the pool the slabs are carved from.
+    explicit SlabPool(size_t capacity)
+        : m_regions(capacity / SlabSize + 2u, false)
+    {
+        m_partial.fill(npos);
+    }
+
+  private:
+    struct Header
+    {
+        uint32_t sizeClass;
+        uint32_t freeCount;
+        size_t prev;
+        size_t next;
+        std::array<uint64_t, SlabSize / SizeClasses.front() / 64u + 1u> bitmap;
+    };
+
+    static constexpr size_t SlotsOffset = (sizeof(Header) + 15u) & ~size_t{15u};
+
+    static_assert(SlabSize > SlotsOffset + MaxSize, "slab cannot hold an object of every class");
+
+    static size_t _classIndex(size_t byteSize)
+    {
+        size_t sizeClass = 0u;
+        while (SizeClasses[sizeClass] < byteSize)
+        {
+            ++sizeClass;
+        }
+        return sizeClass;
+    }
+
+    static size_t _slabOf(const Byte *pool, size_t offset)
+    {
+        return offset - (reinterpret_cast<uintptr_t>(pool + offset) & (SlabSize - 1u));
+    }
+
+    static size_t _region(const Byte *pool, size_t offset)
+    {
+        return (reinterpret_cast<uintptr_t>(pool) + offset) / SlabSize - reinterpret_cast<uintptr_t>(pool) / SlabSize;
+    }
+
+    static uint32_t _capacity(size_t sizeClass)
+    {
+        return static_cast<uint32_t>((SlabSize - SlotsOffset) / SizeClasses[sizeClass]);
+    }
+
+    static Header &_header(Byte *pool, size_t slab)
+    {
+        return *std::launder(reinterpret_cast<Header *>(pool + slab));
+    }
+
+    void _initialise(Byte *pool, size_t slab, size_t sizeClass)
+    {
+        Header &header = *new (pool + slab) Header;
+        const uint32_t capacity = _capacity(sizeClass);
+
+        header.sizeClass = static_cast<uint32_t>(sizeClass);
+        header.freeCount = capacity;
+        header.prev = npos;
+        header.next = npos;
+
+        for (size_t word = 0u; word < header.bitmap.size(); ++word)
+        {
+            const size_t first = word * 64u;
+            header.bitmap[word] = (first >= capacity)         ? 0u
+                                  : (capacity - first >= 64u) ? ~uint64_t{0u}
+                                                              : (uint64_t{1u} << (capacity - first)) - 1u;
+        }
+
+        m_regions[_region(pool, slab)] = true;
+        m_partial[sizeClass] = slab;
+    }
+
+    void _pushFront(Byte *pool, size_t slab)
+    {
+        Header &header = _header(pool, slab);
+        size_t &first = m_partial[header.sizeClass];
+
+        header.prev = npos;
+        header.next = first;
+
+        if (first != npos)
+        {
+            _header(pool, first).prev = slab;
+        }
+
+        first = slab;
+    }
+
+    void _unlink(Byte *pool, size_t slab)
+    {
+        Header &header = _header(pool, slab);
+
+        if (header.prev != npos)
+        {
+            _header(pool, header.prev).next = header.next;
+        }
+        else
+        {
+            m_partial[header.sizeClass] = header.next;
+        }
+
+        if (header.next != npos)
+        {
+            _header(pool, header.next).prev = header.prev;
+        }
+
+        header.prev = npos;
+        header.next = npos;
+    }
+
+    std::array<size_t, SizeClasses.size()> m_partial;
+    std::vector<bool> m_regions;
+};
+
+} // namespace Utility
+} // namespace Yaro
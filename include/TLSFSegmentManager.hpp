@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "BitScan.hpp"
+#include "SegmentManager.hpp"
+
+namespace Yaro
+{
+namespace Utility
+{
+
+using Byte = unsigned char;
+
+// Two-level segregated fit. Free segments sit in doubly linked lists, one per size class: the
+// first level splits sizes by their highest set bit, the second splits every power of two into
+// SecondLevels equal classes. A bitmap per level marks the lists that hold segments, so a fit is
+// a couple of bit scans and adding or deleting a segment links or unlinks a single list entry.
+// Every class also keeps a bound on the sizes in it, which is the largest free segment as long
+// as that has not been deleted while the class still holds others.
+//
+// The lists run through the free segments themselves. The entry of the segment at `head` is the
+// RecordSize bytes at `records + head`, which its owner leaves alone while the segment is free.
+// Segments below MinSegment have no room for one and are not tracked; no request fits them, and
+// MemoryBlock still merges them through their tags.
+class TLSFSegmentManager
+{
+  public:
+    using SegmentBase = SegmentManager::SegmentBase;
+
+    // Segment heads are multiples of HeadUnit, fewer than 2^32 of them.
+    static constexpr size_t HeadUnit = 16u;
+    static constexpr size_t RecordSize = 16u;
+    static constexpr size_t MinSegment = 32u;
+
+    static constexpr size_t SecondLevelBits = 4u;
+    static constexpr size_t SecondLevels = size_t{1u} << SecondLevelBits;
+    static constexpr size_t FirstLevels = 64u;
+    // Entries of its own class a fit looks at when no larger class has a segment.
+    static constexpr size_t FallbackProbes = 4u;
+
+    TLSFSegmentManager()
+        : TLSFSegmentManager(nullptr)
+    {
+    }
+
+    explicit TLSFSegmentManager(Byte *records)
+        : m_records{records}
+    {
+        for (auto &lists : m_lists)
+        {
+            lists.fill(Null);
+        }
+    }
+
+    void addSegment(const SegmentBase &segment)
+    {
+        if (segment.size < MinSegment)
+        {
+            return;
+        }
+
+        size_t first;
+        size_t second;
+        _mapping(segment.size, first, second);
+
+        const uint32_t link = static_cast<uint32_t>(segment.head / HeadUnit);
+        const uint32_t next = m_lists[first][second];
+
+        _write(link, {Null, next, segment.size});
+
+        if (next != Null)
+        {
+            Record record = _read(next);
+            record.prev = link;
+            _write(next, record);
+        }
+
+        m_lists[first][second] = link;
+        m_bounds[first][second] = std::max(m_bounds[first][second], segment.size);
+        m_secondLevel[first] |= uint32_t{1u} << second;
+        m_firstLevel |= uint64_t{1u} << first;
+    }
+
+    bool deleteSegment(const SegmentBase &segment)
+    {
+        if (segment.size < MinSegment)
+        {
+            return true;
+        }
+
+        size_t first;
+        size_t second;
+        _mapping(segment.size, first, second);
+
+        const uint32_t link = static_cast<uint32_t>(segment.head / HeadUnit);
+        const Record record = _read(link);
+
+        if (record.size != segment.size || (record.prev == Null && m_lists[first][second] != link))
+        {
+            return false;
+        }
+
+        if (record.prev != Null)
+        {
+            Record prev = _read(record.prev);
+            prev.next = record.next;
+            _write(record.prev, prev);
+        }
+        else
+        {
+            m_lists[first][second] = record.next;
+        }
+
+        if (record.next != Null)
+        {
+            Record next = _read(record.next);
+            next.prev = record.prev;
+            _write(record.next, next);
+        }
+
+        if (m_lists[first][second] == Null)
+        {
+            m_bounds[first][second] = 0u;
+            m_secondLevel[first] &= ~(uint32_t{1u} << second);
+
+            if (m_secondLevel[first] == 0u)
+            {
+                m_firstLevel &= ~(uint64_t{1u} << first);
+            }
+        }
+
+        return true;
+    }
+
+    // A segment from the lowest class all of whose segments hold `segment.size` bytes, found in
+    // constant time. Only when there is none are the first FallbackProbes entries of the
+    // request's own class tried, so a fit may fail while a segment further down the list fits.
+    bool fitSegment(const SegmentBase &segment, SegmentBase &outSegment) const
+    {
+        size_t first;
+        size_t second;
+        _mapping(segment.size + (size_t{1u} << _classShift(segment.size)) - 1u, first, second);
+
+        if (_findFrom(first, second))
+        {
+            outSegment = _segment(m_lists[first][second]);
+            return true;
+        }
+
+        _mapping(segment.size, first, second);
+
+        if (m_bounds[first][second] < segment.size)
+        {
+            return false;
+        }
+
+        uint32_t link = m_lists[first][second];
+
+        for (size_t probe = 0u; probe < FallbackProbes && link != Null; ++probe)
+        {
+            const Record record = _read(link);
+
+            if (record.size >= segment.size)
+            {
+                outSegment = _segment(link);
+                return true;
+            }
+
+            link = record.next;
+        }
+
+        return false;
+    }
+
+    // The bound of the highest class in use: exact unless the largest segment of that class was
+    // deleted while others stayed, and never beyond the class. Constant time.
+    size_t maxSizeSegment() const
+    {
+        if (m_firstLevel == 0u)
+        {
+            return 0u;
+        }
+
+        const size_t first = highestSetBit(m_firstLevel);
+        const size_t second = highestSetBit(m_secondLevel[first]);
+
+        return m_bounds[first][second];
+    }
+
+  private:
+    static constexpr uint32_t Null = std::numeric_limits<uint32_t>::max();
+
+    struct Record
+    {
+        uint32_t prev;
+        uint32_t next;
+        size_t size;
+    };
+
+    static_assert(sizeof(Record) == RecordSize, "MemoryBlock checks that a record fits into the smallest tracked segment");
+
+    // Sizes below SecondLevels share the first class of the first level.
+    static void _mapping(size_t size, size_t &first, size_t &second)
+    {
+        if (size < SecondLevels)
+        {
+            first = 0u;
+            second = size;
+            return;
+        }
+
+        first = highestSetBit(size);
+        second = (size >> (first - SecondLevelBits)) & (SecondLevels - 1u);
+    }
+
+    // Log2 of the width of the classes `size` falls between.
+    static size_t _classShift(size_t size)
+    {
+        return (size < SecondLevels) ? 0u : highestSetBit(size) - SecondLevelBits;
+    }
+
+    // Moves `first` and `second` to the lowest non-empty class at or above them.
+    bool _findFrom(size_t &first, size_t &second) const
+    {
+        if (first >= FirstLevels)
+        {
+            return false;
+        }
+
+        uint32_t secondMask = m_secondLevel[first] & (~uint32_t{0u} << second);
+
+        if (secondMask == 0u)
+        {
+            const uint64_t firstMask = (first + 1u < FirstLevels) ? m_firstLevel & (~uint64_t{0u} << (first + 1u)) : 0u;
+
+            if (firstMask == 0u)
+            {
+                return false;
+            }
+
+            first = lowestSetBit(firstMask);
+            secondMask = m_secondLevel[first];
+        }
+
+        second = lowestSetBit(secondMask);
+        return true;
+    }
+
+    SegmentBase _segment(uint32_t link) const
+    {
+        return {link * HeadUnit, _read(link).size};
+    }
+
+    Record _read(uint32_t link) const
+    {
+        Record record;
+        std::memcpy(&record, m_records + link * HeadUnit, sizeof(record));
+        return record;
+    }
+
+    void _write(uint32_t link, const Record &record)
+    {
+        std::memcpy(m_records + link * HeadUnit, &record, sizeof(record));
+    }
+
+    Byte *m_records;
+    uint64_t m_firstLevel = 0u;
+    std::array<uint32_t, FirstLevels> m_secondLevel{};
+    std::array<std::array<uint32_t, SecondLevels>, FirstLevels> m_lists;
+    std::array<std::array<size_t, SecondLevels>, FirstLevels> m_bounds{};
+};
+
+} // namespace Utility
+} // namespace Yaro
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+namespace Yaro
+{
+namespace Utility
+{
+
+using Byte = unsigned char;
+
+// Per-thread free lists of recently released small segments, bucketed by rounded byte size.
+// The owner keeps every cached segment allocated in its shared blocks and only sees batched
+// refills and flushes, each taken under a single lock acquisition:
+//     static size_t _refillCache(size_t byteSize, Byte **out, size_t count);
+//     static void _flushCache(Byte **ptrs, size_t count);
+// A flush may reorder the pointers it is given.
+template <typename Owner, size_t Granularity = 16u, size_t NumBuckets = 16u, size_t Capacity = 64u>
+class ThreadCache
+{
+    static_assert(Granularity >= sizeof(Byte *), "cached segments must be able to hold a list link");
+    static_assert(Capacity >= 2u, "a bucket must be able to keep something after a flush");
+
+  public:
+    static constexpr size_t MaxSize = Granularity * NumBuckets;
+    static constexpr size_t BatchSize = Capacity / 2u;
+
+    static bool cacheable(size_t byteSize)
+    {
+        return byteSize != 0u && byteSize <= MaxSize;
+    }
+
+    // Every cached request is served with the full bucket size so segments are interchangeable.
+    static size_t bucketSize(size_t byteSize)
+    {
+        return (_bucketIndex(byteSize) + 1u) * Granularity;
+    }
+
+    static ThreadCache &local()
+    {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    Byte *allocate(size_t byteSize)
+    {
+        Bucket &bucket = m_buckets[_bucketIndex(byteSize)];
+
+        if (bucket.head == nullptr)
+        {
+            _refill(bucket, bucketSize(byteSize));
+        }
+
+        Byte *ptr = bucket.head;
+        bucket.head = _next(ptr);
+        --bucket.count;
+
+        return ptr;
+    }
+
+    void deallocate(Byte *ptr, size_t byteSize)
+    {
+        Bucket &bucket = m_buckets[_bucketIndex(byteSize)];
+
+        _setNext(ptr, bucket.head);
+        bucket.head = ptr;
+
+        if (++bucket.count > Capacity)
+        {
+            _flush(bucket, BatchSize);
+        }
+    }
+
+    // Returns every cached segment to the owner's shared blocks.
+    void flush()
+    {
+        for (auto &bucket : m_buckets)
+        {
+            while (bucket.count != 0u)
+            {
+                _flush(bucket, BatchSize);
+            }
+        }
+    }
+
+    ThreadCache() = default;
+
+    ThreadCache(const ThreadCache &other) = delete;
+    ThreadCache &operator=(const ThreadCache &other) = delete;
+
+    ~ThreadCache()
+    {
+        flush();
+    }
+
+  private:
+    struct Bucket
+    {
+        Byte *head = nullptr;
+        size_t count = 0u;
+    };
+
+    static size_t _bucketIndex(size_t byteSize)
+    {
+        return (byteSize - 1u) / Granularity;
+    }
+
+    // Segments carry no alignment guarantee, so the link is copied rather than dereferenced.
+    static Byte *_next(const Byte *ptr)
+    {
+        Byte *next;
+        std::memcpy(&next, ptr, sizeof(next));
+        return next;
+    }
+
+    static void _setNext(Byte *ptr, Byte *next)
+    {
+        std::memcpy(ptr, &next, sizeof(next));
+    }
+
+    void _refill(Bucket &bucket, size_t byteSize)
+    {
+        std::array<Byte *, BatchSize> batch;
+        const size_t received = Owner::_refillCache(byteSize, batch.data(), batch.size());
+
+        if (received == 0u)
+        {
+            throw std::bad_alloc();
+        }
+
+        for (size_t i = 0u; i < received; ++i)
+        {
+            _setNext(batch[i], bucket.head);
+            bucket.head = batch[i];
+        }
+
+        bucket.count += received;
+    }
+
+    void _flush(Bucket &bucket, size_t count)
+    {
+        std::array<Byte *, BatchSize> batch;
+        size_t released = 0u;
+
+        while (released < count && bucket.head != nullptr)
+        {
+            batch[released++] = bucket.head;
+            bucket.head = _next(bucket.head);
+        }
+
+        bucket.count -= released;
+        Owner::_flushCache(batch.data(), released);
+    }
+
+    std::array<Bucket, NumBuckets> m_buckets{};
+};
+
+} // namespace Utility
+} // namespace Yaro
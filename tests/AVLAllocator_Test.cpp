@@ -1,10 +1,25 @@
 #include "../include/AVLAllocator.hpp"
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
 #include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fstream>
+#include <unistd.h>
+#endif
 
 template <typename T>
 using Allocator1 = Yaro::Utility::AVLAllocator<T, 5, 1000000>;
 
+template <typename T>
+using CachedAllocator = Yaro::Utility::AVLAllocator<T, 2, 1000000, Yaro::Utility::ThreadCachedAllocatorTraits>;
+
 TEST(Allocator, alloc1)
 {
     Allocator1<int> alloc;
@@ -114,6 +129,1139 @@ TEST(Allocator, alloc5)
     t3.join();
 }
 
+TEST(Allocator, coalesce)
+{
+    Yaro::Utility::AVLAllocator<char, 1, 4096> alloc;
+
+    std::vector<char *> ptrs;
+
+    while (ptrs.size() < 4096 / 128)
+    {
+        try
+        {
+            ptrs.push_back(alloc.allocate(128));
+        }
+        catch (const std::bad_alloc &)
+        {
+            break;
+        }
+    }
+
+    EXPECT_GT(ptrs.size(), 16);
+    EXPECT_LT(ptrs.size(), 4096 / 128);
+
+    for (size_t i = 0; i < ptrs.size(); i += 2)
+    {
+        alloc.deallocate(ptrs[i]);
+    }
+    for (size_t i = 1; i < ptrs.size(); i += 2)
+    {
+        alloc.deallocate(ptrs[i]);
+    }
+
+    EXPECT_EQ(alloc.max_size(), 4096);
+
+    char *arr = alloc.allocate(alloc.max_size());
+    EXPECT_EQ(arr, ptrs[0]);
+    alloc.deallocate(arr);
+}
+
+TEST(Allocator, trimHead)
+{
+    Yaro::Utility::AVLAllocator<char, 1, 4096> alloc;
+
+    char *arr = alloc.allocate(1000);
+    char *rest = alloc.deallocate(arr, 200);
+    EXPECT_EQ(rest, arr + 200);
+
+    // The released head is reused for the next request that fits into it.
+    char *head = alloc.allocate(100);
+    EXPECT_EQ(head, arr);
+
+    EXPECT_THROW(alloc.deallocate(rest, 801), std::bad_alloc);
+    EXPECT_EQ(alloc.deallocate(rest, 800), nullptr);
+    EXPECT_THROW(alloc.deallocate(rest), std::bad_alloc);
+    alloc.deallocate(head, 100);
+
+    EXPECT_EQ(alloc.max_size(), 4096);
+}
+
+template <typename Traits>
+static void randomChurn()
+{
+    Yaro::Utility::AVLAllocator<uint32_t, 1, 1 << 20, Traits> alloc;
+
+    constexpr uint32_t liveCount = 128;
+    uint32_t *ptrs[liveCount] = {};
+    size_t sizes[liveCount] = {};
+    uint32_t stamps[liveCount] = {};
+    uint64_t seed = 42;
+
+    for (uint32_t round = 0; round < 50000; ++round)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const uint32_t slot = (seed >> 33) % liveCount;
+
+        if (ptrs[slot] != nullptr)
+        {
+            ASSERT_EQ(std::count(ptrs[slot], ptrs[slot] + sizes[slot], stamps[slot]), sizes[slot]);
+            alloc.deallocate(ptrs[slot], sizes[slot]);
+        }
+
+        sizes[slot] = 17 + (seed >> 45) % 2000;
+        stamps[slot] = round;
+        ptrs[slot] = alloc.allocate(sizes[slot]);
+        std::fill(ptrs[slot], ptrs[slot] + sizes[slot], stamps[slot]);
+    }
+
+    for (uint32_t slot = 0; slot < liveCount; ++slot)
+    {
+        if (ptrs[slot] != nullptr)
+        {
+            ASSERT_EQ(std::count(ptrs[slot], ptrs[slot] + sizes[slot], stamps[slot]), sizes[slot]);
+            alloc.deallocate(ptrs[slot], sizes[slot]);
+        }
+    }
+
+    EXPECT_EQ(alloc.max_size(), (1 << 20) / sizeof(uint32_t));
+}
+
+TEST(Allocator, randomChurn)
+{
+    randomChurn<Yaro::Utility::DefaultAllocatorTraits>();
+}
+
+TEST(Allocator, augmentedTreeChurn)
+{
+    randomChurn<Yaro::Utility::AugmentedFirstFitAllocatorTraits>();
+}
+
+TEST(Allocator, bTreeChurn)
+{
+    randomChurn<Yaro::Utility::BTreeAllocatorTraits>();
+}
+
+TEST(Allocator, tlsfChurn)
+{
+    randomChurn<Yaro::Utility::TLSFAllocatorTraits>();
+}
+
+TEST(Allocator, tlsfFits)
+{
+    using Manager = Yaro::Utility::TLSFSegmentManager;
+
+    // Records live in the segments, 64 bytes apart here.
+    std::vector<Yaro::Utility::Byte> records(4000 * 64 + 64);
+    Manager tlsf(records.data());
+    Yaro::Utility::SegmentManager reference;
+    Manager::SegmentBase found;
+    Manager::SegmentBase expected;
+    uint64_t seed = 3;
+
+    for (size_t head = 0; head < 4000 * 64; head += 64)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const Manager::SegmentBase segment{head, 32 + (seed >> 40) % 2000};
+
+        tlsf.addSegment(segment);
+        reference.addSegment(segment);
+    }
+
+    for (size_t round = 0; round < 20000; ++round)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const size_t size = 32 + (seed >> 40) % 2100;
+
+        // The largest segment is bounded within its class.
+        ASSERT_GE(tlsf.maxSizeSegment(), reference.maxSizeSegment());
+        ASSERT_LE(tlsf.maxSizeSegment(), reference.maxSizeSegment() + reference.maxSizeSegment() / 16);
+
+        // A fit only fails when best fit finds nothing or the request's own class is all that
+        // could serve it, and may only be a little larger than best fit.
+        const bool fits = reference.bestFitSegment({0, size}, expected);
+
+        if (!tlsf.fitSegment({0, size}, found))
+        {
+            ASSERT_TRUE(!fits || expected.size < size + size / 8 + 16);
+        }
+        else
+        {
+            ASSERT_TRUE(fits);
+            EXPECT_GE(found.size, size);
+            EXPECT_LE(found.size, std::max(2 * size, expected.size));
+            EXPECT_FALSE(tlsf.deleteSegment({found.head, found.size + 1}));
+            EXPECT_TRUE(tlsf.deleteSegment(found));
+            EXPECT_TRUE(reference.deleteSegment(found));
+
+            if (found.size > 32)
+            {
+                tlsf.addSegment({found.head, found.size - 1});
+                reference.addSegment({found.head, found.size - 1});
+            }
+        }
+    }
+}
+
+TEST(Allocator, buddyChurn)
+{
+    randomChurn<Yaro::Utility::BuddyAllocatorTraits>();
+}
+
+TEST(Allocator, buddySystem)
+{
+    using Yaro::Utility::Byte;
+    Yaro::Utility::AVLMemoryResource<Yaro::Utility::BuddyAllocatorTraits> resource(1, 1 << 16);
+    std::vector<Byte *> ptrs;
+
+    // Power-of-two requests fill the block exactly.
+    for (size_t i = 0; i < 16; ++i)
+    {
+        ptrs.push_back(resource.tryAllocate(4096));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+    EXPECT_EQ(resource.tryAllocate(128), nullptr);
+    EXPECT_EQ(resource.maxAllocation(), 0u);
+
+    for (size_t i = 0; i < ptrs.size(); i += 2)
+    {
+        resource.release(ptrs[i]);
+    }
+
+    auto stats = resource.stats();
+    EXPECT_EQ(stats.total.freeSegments, 8u);
+    EXPECT_EQ(stats.total.fragmentation(), 0.875);
+
+    for (size_t i = 1; i < ptrs.size(); i += 2)
+    {
+        resource.release(ptrs[i]);
+    }
+
+    stats = resource.stats();
+    EXPECT_EQ(stats.total.freeSegments, 1u);
+    EXPECT_EQ(resource.maxAllocation(), size_t{1 << 16});
+
+    // Trimming the head releases the lower halves it covers.
+    Byte *arr = resource.tryAllocate(3000);
+    EXPECT_EQ(resource.stats().total.usedBytes, 4096u);
+    Byte *rest = resource.release(arr, 2100);
+    EXPECT_EQ(rest, arr + 2100);
+    EXPECT_EQ(resource.stats().total.usedBytes, 2048u);
+    EXPECT_THROW(resource.release(rest, 901), std::bad_alloc);
+    EXPECT_EQ(resource.release(rest, 900), nullptr);
+    EXPECT_THROW(resource.release(rest), std::bad_alloc);
+
+    // Growing takes the free buddies above the segment, shrinking hands back the upper halves.
+    Byte *grown = resource.tryAllocate(1000);
+    ASSERT_EQ(grown, arr);
+    EXPECT_TRUE(resource.tryResize(grown, 4000));
+    EXPECT_EQ(resource.stats().total.usedBytes, 4096u);
+    EXPECT_TRUE(resource.tryResize(grown, 100));
+    EXPECT_EQ(resource.stats().total.usedBytes, 128u);
+
+    Byte *blocker = resource.tryAllocate(128);
+    EXPECT_EQ(blocker, grown + 128);
+    EXPECT_FALSE(resource.tryResize(grown, 200));
+
+    Byte *aligned = resource.tryAllocate(100, 8192);
+    ASSERT_NE(aligned, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 8192, 0u);
+
+    resource.release(aligned);
+    resource.release(blocker);
+    resource.release(grown);
+
+    stats = resource.stats();
+    EXPECT_EQ(stats.total.usedBytes, 0u);
+    EXPECT_EQ(stats.total.allocations, stats.total.deallocations);
+    EXPECT_EQ(resource.maxAllocation(), size_t{1 << 16});
+}
+
+TEST(Allocator, fitPolicies)
+{
+    using Yaro::Utility::BasicSegmentManager;
+    using Yaro::Utility::CompactAVLTree;
+
+    BasicSegmentManager<CompactAVLTree, Yaro::Utility::BestFit> best;
+    BasicSegmentManager<CompactAVLTree, Yaro::Utility::FirstFit> first;
+    BasicSegmentManager<CompactAVLTree, Yaro::Utility::NextFit> next;
+    BasicSegmentManager<CompactAVLTree, Yaro::Utility::WorstFit> worst;
+
+    for (const auto &segment : {Yaro::Utility::SegmentManagerBase::SegmentBase{0, 100}, {1000, 50}, {2000, 300}, {3000, 60}})
+    {
+        best.addSegment(segment);
+        first.addSegment(segment);
+        next.addSegment(segment);
+        worst.addSegment(segment);
+    }
+
+    Yaro::Utility::SegmentManagerBase::SegmentBase found;
+
+    ASSERT_TRUE(best.fitSegment({0, 55}, found));
+    EXPECT_EQ(found.head, 3000u);
+    ASSERT_TRUE(first.fitSegment({0, 55}, found));
+    EXPECT_EQ(found.head, 0u);
+    ASSERT_TRUE(worst.fitSegment({0, 55}, found));
+    EXPECT_EQ(found.head, 2000u);
+
+    // Next fit moves on from each fit and wraps around at the end.
+    for (const size_t head : {0u, 2000u, 3000u, 0u})
+    {
+        ASSERT_TRUE(next.fitSegment({0, 55}, found));
+        EXPECT_EQ(found.head, head);
+    }
+
+    EXPECT_FALSE(best.fitSegment({0, 301}, found));
+    EXPECT_FALSE(first.fitSegment({0, 301}, found));
+    EXPECT_FALSE(next.fitSegment({0, 301}, found));
+    EXPECT_FALSE(worst.fitSegment({0, 301}, found));
+}
+
+template <typename Manager>
+static void bestFitLowestHead()
+{
+    Manager manager;
+
+    // Inserted out of address order, so the lowest head does not end up at the root.
+    for (const size_t head : {7000u, 3000u, 11000u, 1000u, 5000u, 9000u, 13000u, 0u, 2000u, 4000u, 6000u, 8000u,
+                              10000u, 12000u, 14000u})
+    {
+        manager.addSegment({head, 64});
+    }
+
+    Yaro::Utility::SegmentManagerBase::SegmentBase found;
+
+    ASSERT_TRUE(manager.bestFitSegment({0, 64}, found));
+    EXPECT_EQ(found.head, 0u);
+    ASSERT_TRUE(manager.bestFitSegment({5000, 48}, found));
+    EXPECT_EQ(found.head, 0u);
+
+    manager.deleteSegment({0, 64});
+    ASSERT_TRUE(manager.bestFitSegment({0, 64}, found));
+    EXPECT_EQ(found.head, 1000u);
+}
+
+TEST(Allocator, bestFitEqualSizes)
+{
+    bestFitLowestHead<Yaro::Utility::SegmentManager>();
+    bestFitLowestHead<Yaro::Utility::BTreeSegmentManager>();
+}
+
+TEST(Allocator, fitPolicyChurn)
+{
+    randomChurn<Yaro::Utility::FitPolicyAllocatorTraits<Yaro::Utility::FirstFit>>();
+    randomChurn<Yaro::Utility::FitPolicyAllocatorTraits<Yaro::Utility::NextFit>>();
+    randomChurn<Yaro::Utility::FitPolicyAllocatorTraits<Yaro::Utility::WorstFit>>();
+}
+
+TEST(Allocator, augmentedTreeFits)
+{
+    using Manager = Yaro::Utility::AugmentedSegmentManager;
+
+    Manager augmented;
+    Yaro::Utility::SegmentManager reference;
+    Manager::SegmentBase found;
+    Manager::SegmentBase expected;
+    uint64_t seed = 3;
+
+    for (size_t head = 0; head < 4000 * 64; head += 64)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const Manager::SegmentBase segment{head, 16 + (seed >> 40) % 48};
+
+        augmented.addSegment(segment);
+        reference.addSegment(segment);
+    }
+
+    for (size_t round = 0; round < 20000; ++round)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const size_t size = 16 + (seed >> 40) % 48;
+
+        ASSERT_EQ(augmented.maxSizeSegment(), reference.maxSizeSegment());
+        ASSERT_EQ(augmented.bestFitSegment({0, size}, found), reference.bestFitSegment({0, size}, expected));
+
+        if (augmented.firstFitSegment({0, size}, found))
+        {
+            EXPECT_GE(found.size, size);
+        }
+
+        if (augmented.bestFitSegment({0, size}, found))
+        {
+            EXPECT_EQ(found.size, expected.size);
+            EXPECT_EQ(found.head, expected.head);
+            EXPECT_TRUE(augmented.deleteSegment(found));
+            EXPECT_TRUE(reference.deleteSegment(found));
+
+            // Put back a smaller piece at the same address.
+            if (found.size > 16)
+            {
+                augmented.addSegment({found.head, found.size - 1});
+                reference.addSegment({found.head, found.size - 1});
+            }
+        }
+    }
+}
+
+TEST(Allocator, slabs)
+{
+    Yaro::Utility::AVLAllocator<char, 1, 65536> alloc;
+
+    constexpr uint32_t allocationSize = 1000;
+    char *ptrs[allocationSize];
+
+    for (uint32_t i = 0; i < allocationSize; ++i)
+    {
+        const size_t size = 1 + i % 64;
+        ptrs[i] = alloc.allocate(size);
+        std::fill(ptrs[i], ptrs[i] + size, static_cast<char>(i));
+    }
+
+    for (uint32_t i = 0; i < allocationSize; ++i)
+    {
+        const size_t size = 1 + i % 64;
+        EXPECT_EQ(std::count(ptrs[i], ptrs[i] + size, static_cast<char>(i)), size);
+        alloc.deallocate(ptrs[i], size);
+    }
+
+    EXPECT_THROW(alloc.deallocate(ptrs[0]), std::bad_alloc);
+}
+
+TEST(Allocator, slabsTrim)
+{
+    Yaro::Utility::AVLMemoryResource<> resource(1, 1 << 16);
+
+    // Slab objects cannot give back their head, so a count of a smaller class is refused.
+    Yaro::Utility::Byte *ptr = resource.tryAllocate(40);
+    EXPECT_THROW(resource.release(ptr, 20), std::bad_alloc);
+    EXPECT_THROW(resource.release(ptr, 50), std::bad_alloc);
+    EXPECT_THROW(resource.release(ptr + 20, 20), std::bad_alloc);
+    EXPECT_EQ(resource.release(ptr, 40), nullptr);
+
+    // Within the class a count is taken for the whole request.
+    ptr = resource.tryAllocate(32);
+    EXPECT_EQ(resource.release(ptr, 30), nullptr);
+    EXPECT_THROW(resource.release(ptr, 32), std::bad_alloc);
+
+    const auto stats = resource.stats();
+    EXPECT_EQ(stats.total.allocations, 2u);
+    EXPECT_EQ(stats.total.deallocations, 2u);
+}
+
+TEST(Allocator, slabsRelease)
+{
+    Yaro::Utility::AVLAllocator<char, 1, 32768> alloc;
+
+    constexpr uint32_t allocationSize = 1000;
+    char *ptrs[allocationSize];
+
+    for (uint32_t i = 0; i < allocationSize; ++i)
+    {
+        ptrs[i] = alloc.allocate(16);
+    }
+
+    for (uint32_t i = 0; i < allocationSize; ++i)
+    {
+        alloc.deallocate(ptrs[i], 16);
+    }
+
+    // Emptied slabs go back to the free segments while another slab of the class is partial,
+    // so only the first one and its alignment padding stay around.
+    EXPECT_GE(alloc.max_size(), 32768 - 2 * 4096);
+}
+
+template <typename Traits>
+static void slabResize()
+{
+    Yaro::Utility::AVLMemoryResource<Traits> resource(1, 1 << 16);
+
+    // Only sizes of the object's class are accepted, so a later release by size frees it.
+    Yaro::Utility::Byte *ptr = resource.tryAllocate(40);
+    EXPECT_FALSE(resource.tryResize(ptr, 10));
+    EXPECT_FALSE(resource.tryResize(ptr, 100));
+    EXPECT_TRUE(resource.tryResize(ptr, 45));
+    EXPECT_EQ(resource.release(ptr, 45), nullptr);
+
+    const auto stats = resource.stats();
+    EXPECT_EQ(stats.total.allocations, stats.total.deallocations);
+}
+
+TEST(Allocator, slabResize)
+{
+    slabResize<Yaro::Utility::DefaultAllocatorTraits>();
+    slabResize<Yaro::Utility::BuddyAllocatorTraits>();
+}
+
+TEST(Allocator, threadCacheReuse)
+{
+    CachedAllocator<char> alloc;
+
+    char *a = alloc.allocate(20);
+    alloc.deallocate(a, 20);
+
+    char *b = alloc.allocate(24);
+    EXPECT_EQ(a, b);
+    alloc.deallocate(b, 24);
+}
+
+TEST(Allocator, threadCacheAligned)
+{
+    CachedAllocator<char> alloc;
+
+    // Aligned requests of cacheable sizes hold a whole bucket, so the cache may take them back.
+    char *p = alloc.allocate_aligned(8, 8);
+    char *p2 = alloc.allocate_aligned(8, 8);
+    char *p3 = alloc.allocate_aligned(8, 64);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p3) % 64, 0u);
+
+    alloc.deallocate(p, 8);
+    alloc.deallocate(p3, 8);
+
+    char *q = alloc.allocate(16);
+    char *q2 = alloc.allocate(16);
+
+    for (char *ptr : {q, q2})
+    {
+        EXPECT_TRUE(ptr + 16 <= p2 || ptr >= p2 + 16);
+    }
+
+    alloc.deallocate(q, 16);
+    alloc.deallocate(q2, 16);
+    alloc.deallocate(p2, 8);
+}
+
+template <typename Alloc>
+static void threadedChurn(Alloc &alloc, uint64_t numThreads)
+{
+    const auto churn = [&alloc](uint64_t seed) -> void {
+        constexpr uint32_t liveCount = 256;
+        uint64_t *ptrs[liveCount] = {};
+        size_t sizes[liveCount] = {};
+
+        for (uint32_t round = 0; round < 20000; ++round)
+        {
+            const uint32_t slot = (seed = seed * 6364136223846793005ull + 1442695040888963407ull) >> 56;
+
+            if (ptrs[slot] != nullptr)
+            {
+                for (size_t i = 0; i < sizes[slot]; ++i)
+                {
+                    ASSERT_EQ(ptrs[slot][i], reinterpret_cast<uint64_t>(ptrs[slot]));
+                }
+                alloc.deallocate(ptrs[slot], sizes[slot]);
+            }
+
+            sizes[slot] = 1 + (seed >> 40) % 40;
+            ptrs[slot] = alloc.allocate(sizes[slot]);
+
+            for (size_t i = 0; i < sizes[slot]; ++i)
+            {
+                ptrs[slot][i] = reinterpret_cast<uint64_t>(ptrs[slot]);
+            }
+        }
+
+        for (uint32_t slot = 0; slot < liveCount; ++slot)
+        {
+            if (ptrs[slot] != nullptr)
+            {
+                alloc.deallocate(ptrs[slot], sizes[slot]);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back(churn, i + 1);
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+TEST(Allocator, threadCacheChurn)
+{
+    CachedAllocator<uint64_t> alloc;
+
+    threadedChurn(alloc, 8);
+}
+
+TEST(Allocator, shardedChurn)
+{
+    Yaro::Utility::AVLAllocator<uint64_t, 4, 1 << 20> alloc;
+
+    threadedChurn(alloc, 8);
+}
+
+TEST(Allocator, growingChurn)
+{
+    // Too small for the live set of all threads, so blocks are added while they run.
+    Yaro::Utility::AVLAllocator<uint64_t, 1, 1 << 17, Yaro::Utility::GrowingAllocatorTraits> alloc;
+
+    threadedChurn(alloc, 8);
+    EXPECT_GT(alloc.resource()->stats().blocks.size(), 1u);
+}
+
+TEST(Allocator, alignedAllocations)
+{
+    Yaro::Utility::AVLAllocator<char, 1, 1 << 18> alloc;
+
+    constexpr size_t alignments[] = {1, 8, 16, 32, 64, 256, 4096};
+    std::vector<std::pair<char *, size_t>> ptrs;
+
+    for (size_t i = 0; i < 200; ++i)
+    {
+        const size_t alignment = alignments[i % std::size(alignments)];
+        const size_t size = 1 + (i * 37) % 300;
+
+        ptrs.emplace_back(alloc.allocate(1 + i % 7), 1 + i % 7);
+        ptrs.emplace_back(alloc.allocate_aligned(size, alignment), size);
+
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(ptrs.back().first) % alignment, 0u);
+        std::fill(ptrs.back().first, ptrs.back().first + size, static_cast<char>(i));
+    }
+
+    for (size_t i = 1; i < ptrs.size(); i += 2)
+    {
+        EXPECT_EQ(std::count(ptrs[i].first, ptrs[i].first + ptrs[i].second, static_cast<char>(i / 2)), ptrs[i].second);
+    }
+
+    for (const auto &ptr : ptrs)
+    {
+        alloc.deallocate(ptr.first, ptr.second);
+    }
+
+    EXPECT_THROW(alloc.allocate_aligned(1, 48), std::bad_alloc);
+}
+
+TEST(Allocator, overAlignedType)
+{
+    struct alignas(64) CacheLine
+    {
+        char bytes[64];
+    };
+
+    Yaro::Utility::AVLAllocator<CacheLine, 1, 1 << 16, Yaro::Utility::ThreadCachedAllocatorTraits> alloc;
+
+    for (size_t n = 1; n < 20; ++n)
+    {
+        CacheLine *lines = alloc.allocate(n);
+
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(lines) % 64, 0u);
+
+        alloc.deallocate(lines, n);
+    }
+}
+
+TEST(Allocator, sharedArena)
+{
+    using Bytes = Yaro::Utility::AVLAllocator<char, 1, 1 << 17>;
+    using Words = Bytes::rebind<uint64_t>::other;
+
+    Bytes bytes;
+    Words words{bytes};
+
+    EXPECT_TRUE(bytes == words);
+
+    uint64_t *ptr = words.allocate(4096);
+    EXPECT_LT(bytes.max_size(), size_t{1 << 17} - 4096 * sizeof(uint64_t) + 64);
+
+    // A segment allocated through one value type can be released through another.
+    bytes.deallocate(reinterpret_cast<char *>(ptr));
+    EXPECT_EQ(bytes.max_size(), size_t{1 << 17});
+
+    std::map<int, int, std::less<int>, Bytes::rebind<std::pair<const int, int>>::other> map;
+    for (int i = 0; i < 1000; ++i)
+    {
+        map.emplace(i, -i);
+    }
+
+    EXPECT_LT(bytes.max_size(), size_t{1 << 17} - 1000 * sizeof(std::pair<const int, int>));
+    map.clear();
+}
+
+TEST(Allocator, hugePages)
+{
+    Yaro::Utility::AVLAllocator<char, 2, 3 << 20, Yaro::Utility::HugePageAllocatorTraits> alloc;
+
+    char *big = alloc.allocate(3 << 20);
+    char *small = alloc.allocate(100);
+
+    std::fill(big, big + (3 << 20), 'x');
+    std::fill(small, small + 100, 'y');
+
+    EXPECT_EQ(std::count(big, big + (3 << 20), 'x'), 3 << 20);
+
+    alloc.deallocate(big);
+    alloc.deallocate(small);
+
+    EXPECT_EQ(alloc.max_size(), 3u << 20);
+}
+
+#ifdef __linux__
+static size_t residentBytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0;
+    size_t resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+TEST(Allocator, lazyCommit)
+{
+    constexpr size_t blockSize = size_t{1} << 30;
+    constexpr size_t touched = size_t{64} << 20;
+
+    Yaro::Utility::AVLAllocator<char, 4, blockSize> alloc;
+
+    // Four gigabytes of blocks exist since static initialisation, but none of it is resident.
+    EXPECT_LT(residentBytes(), blockSize / 4);
+
+    char *ptr = alloc.allocate(touched);
+    std::fill(ptr, ptr + touched, 'x');
+    const size_t committed = residentBytes();
+
+    alloc.deallocate(ptr);
+
+    EXPECT_LT(residentBytes() + touched / 2, committed);
+}
+#endif
+
+TEST(Allocator, memoryResource)
+{
+    Yaro::Utility::AVLMemoryResource<> resource(2, 1 << 16);
+
+    {
+        std::pmr::vector<uint64_t> vector(&resource);
+        std::pmr::map<int, int> map(&resource);
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            vector.push_back(i);
+            map.emplace(i, -i);
+        }
+
+        EXPECT_EQ(vector[999], 999u);
+        EXPECT_EQ(map.at(500), -500);
+        EXPECT_LT(resource.maxAllocation(), size_t{1 << 16});
+    }
+
+    // Map nodes come from slabs, which blocks keep once carved.
+    EXPECT_GT(resource.maxAllocation(), size_t{1 << 15});
+    EXPECT_THROW((void)resource.allocate(size_t{1 << 17}), std::bad_alloc);
+}
+
+TEST(Allocator, independentResources)
+{
+    using Resource = Yaro::Utility::AVLMemoryResource<Yaro::Utility::AugmentedFirstFitAllocatorTraits>;
+    using Alloc = Yaro::Utility::AVLAllocator<char, 1, 1 << 16, Yaro::Utility::AugmentedFirstFitAllocatorTraits>;
+
+    Resource first(1, 1 << 16);
+    Resource second(1, 1 << 12);
+
+    Alloc a(first);
+    Alloc b(second);
+
+    EXPECT_FALSE(a == b);
+    EXPECT_TRUE(a == Alloc(first));
+    EXPECT_FALSE(a == Alloc());
+
+    char *ptr = a.allocate(1 << 15);
+    EXPECT_EQ(b.max_size(), size_t{1 << 12});
+    EXPECT_THROW(b.allocate(1 << 13), std::bad_alloc);
+
+    a.deallocate(ptr);
+    EXPECT_EQ(a.max_size(), size_t{1 << 16});
+}
+
+TEST(Allocator, bulk)
+{
+    using Alloc = Yaro::Utility::AVLAllocator<char, 1, 1 << 20>;
+
+    Alloc::Resource resource(2, 1 << 20);
+    Alloc alloc(resource);
+
+    std::mt19937 rng(7);
+    std::vector<size_t> counts(500);
+    std::vector<char *> ptrs(counts.size());
+
+    for (auto &count : counts)
+    {
+        count = 1 + rng() % 2000;
+    }
+
+    alloc.allocate_bulk(counts.data(), ptrs.data(), counts.size());
+
+    for (size_t i = 0; i < ptrs.size(); ++i)
+    {
+        std::fill(ptrs[i], ptrs[i] + counts[i], static_cast<char>(i));
+    }
+    for (size_t i = 0; i < ptrs.size(); ++i)
+    {
+        EXPECT_EQ(std::count(ptrs[i], ptrs[i] + counts[i], static_cast<char>(i)), static_cast<ptrdiff_t>(counts[i]));
+    }
+
+    std::shuffle(ptrs.begin(), ptrs.end(), rng);
+    alloc.deallocate_bulk(ptrs.data(), ptrs.size());
+
+    EXPECT_EQ(alloc.max_size(), size_t{1 << 20});
+
+    // A batch that does not fit leaves nothing behind.
+    std::vector<size_t> large(3, size_t{1 << 19} + 1);
+    EXPECT_THROW(alloc.allocate_bulk(large.data(), ptrs.data(), large.size()), std::bad_alloc);
+    EXPECT_EQ(alloc.max_size(), size_t{1 << 20});
+
+    char *ptr = alloc.allocate(100);
+    char *twice[] = {ptr, ptr};
+    EXPECT_THROW(alloc.deallocate_bulk(twice, 2), std::bad_alloc);
+}
+
+TEST(Allocator, reallocate)
+{
+    using Alloc = Yaro::Utility::AVLAllocator<uint32_t, 1, 1 << 16>;
+
+    Alloc::Resource resource(1, 1 << 16);
+    Alloc alloc(resource);
+
+    uint32_t *ptr = alloc.allocate(100);
+    std::iota(ptr, ptr + 100, 0u);
+
+    // Growing into the free space behind it keeps the address.
+    EXPECT_TRUE(alloc.try_expand(ptr, 100, 1000));
+    EXPECT_EQ(ptr[99], 99u);
+    EXPECT_EQ(alloc.max_size(), ((1 << 16) - 1000 * sizeof(uint32_t) - 16) / sizeof(uint32_t));
+    EXPECT_EQ(resource.stats().total.peakUsedBytes, 1000 * sizeof(uint32_t) + 16);
+
+    // Shrinking hands the tail back.
+    EXPECT_TRUE(alloc.try_expand(ptr, 1000, 200));
+    EXPECT_EQ(alloc.max_size(), ((1 << 16) - 200 * sizeof(uint32_t) - 16) / sizeof(uint32_t));
+
+    uint32_t *blocker = alloc.allocate(100);
+    EXPECT_FALSE(alloc.try_expand(ptr, 200, 300));
+
+    uint32_t *moved = alloc.reallocate(ptr, 200, 300);
+    EXPECT_NE(moved, ptr);
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(moved[i], i);
+    }
+
+    // The moved buffer has free space behind it again.
+    EXPECT_EQ(alloc.reallocate(moved, 300, 400), moved);
+
+    alloc.deallocate(moved);
+    alloc.deallocate(blocker);
+    EXPECT_EQ(alloc.max_size(), size_t{(1 << 16) / sizeof(uint32_t)});
+}
+
+TEST(Allocator, makeSharedOutlivesCall)
+{
+    using Alloc = Yaro::Utility::AVLAllocator<uint64_t, 1, 1 << 16>;
+
+    Alloc::Resource resource(1, 1 << 16);
+
+    // The deleter runs after allocMakeShared returned, so it must not refer to its parameter.
+    std::shared_ptr<uint64_t> ptr = Yaro::Utility::allocMakeShared<uint64_t>(Alloc(resource), 42u);
+    uint64_t *const raw = ptr.get();
+    EXPECT_EQ(*ptr, 42u);
+
+    // The released slot is the first one handed out again.
+    ptr.reset();
+    Alloc alloc(resource);
+    uint64_t *again = alloc.allocate(1);
+    EXPECT_EQ(again, raw);
+    alloc.deallocate(again);
+}
+
+TEST(Allocator, stats)
+{
+    Yaro::Utility::AVLMemoryResource<> resource(2, 1 << 16);
+
+    auto stats = resource.stats();
+    EXPECT_EQ(stats.blocks.size(), 2u);
+    EXPECT_EQ(stats.total.usedBytes, 0u);
+    EXPECT_EQ(stats.total.freeSegments, 2u);
+    EXPECT_EQ(stats.total.fragmentation(), 0.5);
+
+    std::vector<Yaro::Utility::Byte *> ptrs;
+    for (size_t i = 0; i < 20; ++i)
+    {
+        ptrs.push_back(resource.tryAllocate(1000));
+    }
+    Yaro::Utility::Byte *small = resource.tryAllocate(32);
+
+    // Every other segment freed leaves holes no larger than one allocation, next to the
+    // padding in front of the slab and the free tail behind it.
+    for (size_t i = 0; i < ptrs.size(); i += 2)
+    {
+        resource.release(ptrs[i]);
+    }
+
+    stats = resource.stats();
+    const auto &block = stats.blocks[0].allocations != 0u ? stats.blocks[0] : stats.blocks[1];
+
+    EXPECT_EQ(stats.total.allocations, 21u);
+    EXPECT_EQ(stats.total.deallocations, 10u);
+    EXPECT_EQ(block.freeSegments, 12u);
+    EXPECT_EQ(block.usedBytes, 10 * 1024u + 4112u);
+    EXPECT_EQ(block.peakUsedBytes, 20 * 1024u + 4112u);
+    EXPECT_GT(block.fragmentation(), 0.2);
+    EXPECT_LT(block.fragmentation(), 0.4);
+    EXPECT_EQ(stats.histogram[Yaro::Utility::histogramBin(1000)], 20u);
+    EXPECT_EQ(stats.histogram[Yaro::Utility::histogramBin(32)], 1u);
+
+    EXPECT_EQ(resource.tryAllocate(1 << 17), nullptr);
+    EXPECT_EQ(resource.stats().failures, 1u);
+
+    for (size_t i = 1; i < ptrs.size(); i += 2)
+    {
+        resource.release(ptrs[i]);
+    }
+    resource.release(small);
+
+    stats = resource.stats();
+    EXPECT_EQ(stats.total.allocations, stats.total.deallocations);
+    // Only the slab stays behind.
+    EXPECT_EQ(stats.total.usedBytes, 4112u);
+}
+
+TEST(Allocator, trace)
+{
+    using Alloc = Yaro::Utility::AVLAllocator<uint64_t, 1, 1 << 16, Yaro::Utility::TracedAllocatorTraits>;
+    using Yaro::Utility::AllocationTrace;
+    using Yaro::Utility::TraceEvent;
+
+    const std::string path = ::testing::TempDir() + "avlallocator.trace";
+    Alloc alloc;
+
+    // Nothing is recorded while no trace is open.
+    alloc.deallocate(alloc.allocate(4));
+
+    ASSERT_TRUE(AllocationTrace::open(path.c_str()));
+    EXPECT_FALSE(AllocationTrace::open(path.c_str()));
+
+    uint64_t *first = alloc.allocate(10);
+    uint64_t *second = alloc.allocate(20);
+    uint64_t *rest = alloc.deallocate(second, 8);
+    EXPECT_TRUE(alloc.try_expand(rest, 12, 100));
+    alloc.deallocate(first);
+    alloc.deallocate(rest);
+
+    std::thread([&alloc] { alloc.deallocate(alloc.allocate(1)); }).join();
+
+    AllocationTrace::close();
+
+    std::vector<Yaro::Utility::TraceRecord> records;
+    ASSERT_TRUE(AllocationTrace::read(path.c_str(), records));
+    ASSERT_EQ(records.size(), 8u);
+
+    // The other thread flushed its buffer when it exited, ahead of this thread's.
+    EXPECT_EQ(records[0].event, TraceEvent::Allocate);
+    EXPECT_EQ(records[0].size, 8u);
+    EXPECT_NE(records[0].thread, records[2].thread);
+
+    EXPECT_EQ(records[2].event, TraceEvent::Allocate);
+    EXPECT_EQ(records[2].pointer, reinterpret_cast<uintptr_t>(first));
+    EXPECT_EQ(records[2].size, 80u);
+    EXPECT_EQ(records[4].event, TraceEvent::Deallocate);
+    EXPECT_EQ(records[4].size, 64u);
+    EXPECT_EQ(records[5].event, TraceEvent::Resize);
+    EXPECT_EQ(records[5].pointer, reinterpret_cast<uintptr_t>(rest));
+    EXPECT_EQ(records[5].size, 800u);
+    EXPECT_EQ(records[7].event, TraceEvent::Deallocate);
+    EXPECT_EQ(records[7].size, 0u);
+
+    for (size_t i = 3; i < records.size(); ++i)
+    {
+        EXPECT_LE(records[i - 1].time, records[i].time);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(Allocator, blockIndex)
+{
+    Yaro::Utility::AVLMemoryResource<> resource(16, 1 << 16);
+    std::vector<Yaro::Utility::Byte *> ptrs;
+
+    for (size_t i = 0; i < 16; ++i)
+    {
+        ptrs.push_back(resource.tryAllocate(60000));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+
+    EXPECT_LT(resource.maxAllocation(), 60000u);
+    EXPECT_EQ(resource.tryAllocate(60000), nullptr);
+
+    // The one block with room is found directly, whichever block is home.
+    resource.release(ptrs[11]);
+    EXPECT_EQ(resource.maxAllocation(), size_t{1 << 16});
+
+    ptrs[11] = resource.tryAllocate(50000);
+    ASSERT_NE(ptrs[11], nullptr);
+
+    const auto stats = resource.stats();
+    size_t fullBlocks = 0;
+    for (const auto &block : stats.blocks)
+    {
+        fullBlocks += (block.largestFreeSegment < 50000u) ? 1u : 0u;
+    }
+    EXPECT_EQ(fullBlocks, 16u);
+    EXPECT_LT(resource.maxAllocation(), 60000u);
+
+    for (auto ptr : ptrs)
+    {
+        resource.release(ptr);
+    }
+    EXPECT_EQ(resource.maxAllocation(), size_t{1 << 16});
+}
+
+TEST(Allocator, blockIndexUpdates)
+{
+    constexpr size_t Slots = 8;
+    Yaro::Utility::BlockIndex index(Slots);
+    std::vector<std::thread> threads;
+
+    // Neighbouring slots share ancestors, so their updates race on every level.
+    for (size_t slot = 0; slot < Slots; ++slot)
+    {
+        threads.emplace_back([&index, slot]() {
+            uint64_t seed = slot + 1;
+            for (size_t round = 0; round < 20000; ++round)
+            {
+                seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+                index.update(slot, (seed >> 40) % 1000);
+            }
+            index.update(slot, 100 * slot);
+        });
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(index.max(), 100 * (Slots - 1));
+    EXPECT_EQ(index.find(1, 0), 1u);
+    EXPECT_EQ(index.find(650, 0), 7u);
+    EXPECT_EQ(index.find(701, 0), Yaro::Utility::BlockIndex::npos);
+}
+
+TEST(Allocator, remoteFrees)
+{
+    Yaro::Utility::AVLMemoryResource<> resource(2, 1 << 20);
+
+    constexpr size_t Messages = 20000;
+    std::vector<std::atomic<Yaro::Utility::Byte *>> queue(Messages);
+
+    // One thread allocates message buffers, another frees them; frees that find the block
+    // locked by the producer are queued on it and released by the producer's next allocations.
+    std::thread producer([&]() {
+        std::mt19937 rng(11);
+        for (size_t i = 0; i < Messages; ++i)
+        {
+            Yaro::Utility::Byte *ptr = nullptr;
+            while ((ptr = resource.tryAllocate(8 + rng() % 2000)) == nullptr)
+            {
+                std::this_thread::yield();
+            }
+            ptr[0] = static_cast<Yaro::Utility::Byte>(i);
+            queue[i].store(ptr, std::memory_order_release);
+        }
+    });
+
+    std::thread consumer([&]() {
+        for (size_t i = 0; i < Messages; ++i)
+        {
+            Yaro::Utility::Byte *ptr;
+            while ((ptr = queue[i].load(std::memory_order_acquire)) == nullptr)
+            {
+                std::this_thread::yield();
+            }
+            EXPECT_EQ(ptr[0], static_cast<Yaro::Utility::Byte>(i));
+            resource.release(ptr);
+        }
+    });
+
+    producer.join();
+    consumer.join();
+
+    const auto stats = resource.stats();
+    EXPECT_EQ(stats.total.allocations, stats.total.deallocations);
+    EXPECT_EQ(resource.maxAllocation(), size_t{1 << 20});
+}
+
+TEST(Allocator, growAndRetire)
+{
+    using namespace std::chrono_literals;
+
+    Yaro::Utility::AVLMemoryResource<> resource(1, 1 << 16, 4, 20ms);
+    std::vector<Yaro::Utility::Byte *> ptrs;
+
+    for (size_t i = 0; i < 4; ++i)
+    {
+        ptrs.push_back(resource.tryAllocate(60000));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+
+    // The cap is reached.
+    EXPECT_EQ(resource.tryAllocate(60000), nullptr);
+    EXPECT_LT(resource.maxAllocation(), 60000u);
+    EXPECT_EQ(resource.stats().activeBlocks, 4u);
+
+    for (auto ptr : ptrs)
+    {
+        resource.release(ptr);
+    }
+
+    // Empty blocks are only retired once the delay has passed, and never the initial one.
+    EXPECT_EQ(resource.trim(), 0u);
+    std::this_thread::sleep_for(30ms);
+    EXPECT_EQ(resource.trim(), 3u);
+
+    auto stats = resource.stats();
+    EXPECT_EQ(stats.activeBlocks, 1u);
+    EXPECT_EQ(stats.blocks.size(), 4u);
+    EXPECT_FALSE(stats.blocks[0].dormant);
+    EXPECT_TRUE(stats.blocks[3].dormant);
+    EXPECT_EQ(resource.maxAllocation(), size_t{1 << 16});
+
+    // Growing again brings retired blocks back before adding any.
+    ptrs[0] = resource.tryAllocate(60000);
+    ptrs[1] = resource.tryAllocate(60000);
+    ASSERT_NE(ptrs[1], nullptr);
+
+    stats = resource.stats();
+    EXPECT_EQ(stats.activeBlocks, 2u);
+    EXPECT_EQ(stats.blocks.size(), 4u);
+
+    resource.release(ptrs[0]);
+    resource.release(ptrs[1]);
+}
+
+TEST(Allocator, growingArena)
+{
+    Yaro::Utility::AVLAllocator<char, 1, 1 << 16, Yaro::Utility::GrowingAllocatorTraits> alloc;
+
+    std::vector<char *> ptrs;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        ptrs.push_back(alloc.allocate(40000));
+    }
+
+    EXPECT_EQ(alloc.resource()->stats().activeBlocks, 8u);
+
+    for (auto ptr : ptrs)
+    {
+        alloc.deallocate(ptr);
+    }
+
+    EXPECT_THROW(alloc.allocate((1 << 16) + 1), std::bad_alloc);
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -1,9 +1,18 @@
 #include "../include/AVLTree.hpp"
+#include "../include/BPlusTree.hpp"
+#include "../include/SegmentManager.hpp"
+#include <algorithm>
 #include <cmath>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <set>
+#include <string>
 
-static void insertRange(Yaro::Utility::AVLTree<int> &tree, int begin, int end);
+template <template <typename> class Storage>
+static void insertRange(Yaro::Utility::AVLTree<int, Storage> &tree, int begin, int end);
+
+template <template <typename> class Storage>
+static void randomInsertPop(Yaro::Utility::AVLTree<int, Storage> &tree);
 
 TEST(SmallAVLTreeTest, insertion1)
 {
@@ -166,6 +175,215 @@ TEST(SmallAVLTree, move2)
     EXPECT_TRUE(tree2 != tree1);
 }
 
+TEST(SmallAVLTree, randomInsertPop)
+{
+    Yaro::Utility::AVLTree<int> tree;
+
+    randomInsertPop(tree);
+}
+
+TEST(SmallAVLTree, popInnerNodes)
+{
+    Yaro::Utility::AVLTree<std::string> tree;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        tree.insert(std::to_string(i));
+    }
+
+    for (int i = 0; i < 1000; i += 2)
+    {
+        EXPECT_TRUE(tree.pop(std::to_string(i)));
+    }
+
+    EXPECT_EQ(tree.size(), 500u);
+    EXPECT_LE(tree.height(), static_cast<uint8_t>(1.45 * std::log2(500 + 2)));
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(tree.find(std::to_string(i)), i % 2 == 1);
+    }
+}
+
+TEST(CompactAVLTree, randomInsertPop)
+{
+    Yaro::Utility::AVLTree<int, Yaro::Utility::CompactNodes> tree;
+
+    randomInsertPop(tree);
+}
+
+TEST(CompactAVLTree, copyMove)
+{
+    Yaro::Utility::AVLTree<int, Yaro::Utility::CompactNodes> tree1;
+
+    insertRange(tree1, -10000, 10000);
+
+    auto tree2{tree1};
+    auto tree3{std::move(tree1)};
+
+    EXPECT_TRUE(tree2 == tree3);
+    EXPECT_TRUE(tree2 != tree1);
+
+    tree1.insert(5);
+    tree3 = tree1;
+
+    EXPECT_TRUE(tree1 == tree3);
+    EXPECT_EQ(tree3.count(5), 1u);
+}
+
+TEST(CompactAVLTree, smallerThanPooled)
+{
+    Yaro::Utility::AVLTree<int> pooled;
+    Yaro::Utility::AVLTree<int, Yaro::Utility::CompactNodes> compact;
+
+    insertRange(pooled, 0, 100000);
+    insertRange(compact, 0, 100000);
+
+    EXPECT_EQ(pooled.height(), compact.height());
+    EXPECT_LT(compact.memoryUsage(), pooled.memoryUsage());
+}
+
+TEST(BPlusTree, randomInsertPop)
+{
+    Yaro::Utility::BPlusTree<int> tree;
+    std::set<int> reference;
+    uint64_t seed = 7;
+    int found;
+
+    for (int i = 0; i < 200000; ++i)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const int key = static_cast<int>((seed >> 33) % 5000) - 2500;
+
+        if ((seed >> 20) % 3 == 0)
+        {
+            EXPECT_EQ(tree.pop(key), reference.erase(key) == 1u);
+        }
+        else
+        {
+            EXPECT_EQ(tree.insert(key), reference.insert(key).second);
+        }
+
+        const auto greaterEqual = reference.lower_bound(key);
+        ASSERT_EQ(tree.findClosestGreaterEqual(key, found), greaterEqual != reference.end());
+        if (greaterEqual != reference.end())
+        {
+            ASSERT_EQ(found, *greaterEqual);
+        }
+
+        const auto greater = reference.upper_bound(key);
+        ASSERT_EQ(tree.findClosestGreater(key, found), greater != reference.end());
+        if (greater != reference.end())
+        {
+            ASSERT_EQ(found, *greater);
+        }
+
+        ASSERT_EQ(tree.findClosestLesser(key, found), greaterEqual != reference.begin());
+        if (greaterEqual != reference.begin())
+        {
+            ASSERT_EQ(found, *std::prev(greaterEqual));
+        }
+    }
+
+    EXPECT_EQ(tree.size(), reference.size());
+    ASSERT_TRUE(tree.findMax(found));
+    EXPECT_EQ(found, *reference.rbegin());
+    ASSERT_TRUE(tree.findMin(found));
+    EXPECT_EQ(found, *reference.begin());
+
+    for (int key = -2500; key < 2500; ++key)
+    {
+        EXPECT_EQ(tree.find(key), reference.count(key) == 1u);
+    }
+
+    // Emptying the tree collapses it back to a single leaf.
+    for (const int key : reference)
+    {
+        EXPECT_TRUE(tree.pop(key));
+    }
+    EXPECT_EQ(tree.size(), 0u);
+    EXPECT_FALSE(tree.findMax(found));
+    EXPECT_FALSE(tree.findClosestGreaterEqual(0, found));
+}
+
+TEST(BPlusTree, equalPrimaryKeys)
+{
+    using Manager = Yaro::Utility::SegmentManager;
+    using Segment = Manager::Segment<Manager::SizeHeavy>;
+
+    // Few sizes over many addresses, so runs of equal sizes span many nodes.
+    Yaro::Utility::BPlusTree<Segment> tree;
+    std::set<Segment> reference;
+
+    for (size_t head = 0; head < 20000; ++head)
+    {
+        tree.insert({head * 64, 16 + (head * 7919) % 5 * 16});
+        reference.insert({head * 64, 16 + (head * 7919) % 5 * 16});
+    }
+
+    for (size_t head = 0; head < 20000; head += 3)
+    {
+        EXPECT_TRUE(tree.pop({head * 64, 16 + (head * 7919) % 5 * 16}));
+        reference.erase({head * 64, 16 + (head * 7919) % 5 * 16});
+    }
+
+    Segment found;
+    for (size_t size = 0; size < 112; size += 8)
+    {
+        for (size_t head = 0; head < 20000 * 64; head += 4999)
+        {
+            const Segment key{head, size};
+            const auto expected = reference.lower_bound(key);
+
+            ASSERT_EQ(tree.findClosestGreaterEqual(key, found), expected != reference.end());
+            if (expected != reference.end())
+            {
+                EXPECT_TRUE(found == *expected);
+            }
+        }
+    }
+}
+
+template <typename Tree>
+static void findFirstGreaterEqual()
+{
+    Tree tree;
+    std::set<int> reference;
+
+    for (int key = 0; key < 20000; key += 3)
+    {
+        tree.insert(key);
+        reference.insert(key);
+    }
+
+    const auto divisible = [](int divisor) { return [divisor](int key) { return key % divisor == 0; }; };
+    int found;
+
+    for (int from = -5; from < 20005; from += 97)
+    {
+        for (const int divisor : {1, 7, 1000, 30011})
+        {
+            const auto expected = std::find_if(reference.lower_bound(from), reference.end(), divisible(divisor));
+
+            ASSERT_EQ(tree.findFirstGreaterEqual(from, divisible(divisor), found), expected != reference.end());
+            if (expected != reference.end())
+            {
+                EXPECT_EQ(found, *expected);
+            }
+        }
+    }
+}
+
+TEST(CompactAVLTree, findFirstGreaterEqual)
+{
+    findFirstGreaterEqual<Yaro::Utility::AVLTree<int, Yaro::Utility::CompactNodes>>();
+}
+
+TEST(BPlusTree, findFirstGreaterEqual)
+{
+    findFirstGreaterEqual<Yaro::Utility::BPlusTree<int>>();
+}
+
 class LargeAVLTreeTest : public ::testing::Test
 {
   protected:
@@ -379,10 +597,47 @@ int main(int argc, char **argv)
     return ret;
 }
 
-void insertRange(Yaro::Utility::AVLTree<int> &tree, int begin, int end)
+template <template <typename> class Storage>
+void insertRange(Yaro::Utility::AVLTree<int, Storage> &tree, int begin, int end)
 {
     for (int i = begin; i <= end; i++)
     {
         tree.insert(i);
     }
-}
\ No newline at end of file
+}
+
+template <template <typename> class Storage>
+void randomInsertPop(Yaro::Utility::AVLTree<int, Storage> &tree)
+{
+    std::multiset<int> reference;
+    uint64_t seed = 7;
+
+    for (int i = 0; i < 200000; ++i)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const int key = static_cast<int>((seed >> 33) % 5000);
+
+        if ((seed >> 20) % 3 == 0)
+        {
+            const auto it = reference.find(key);
+            EXPECT_EQ(tree.pop(key), it != reference.end());
+            if (it != reference.end())
+            {
+                reference.erase(it);
+            }
+        }
+        else
+        {
+            tree.insert(key);
+            reference.insert(key);
+        }
+    }
+
+    EXPECT_EQ(tree.size(), reference.size());
+    EXPECT_LE(tree.height(), static_cast<uint8_t>(1.45 * std::log2(5000 + 2)));
+
+    for (int key = 0; key < 5000; ++key)
+    {
+        EXPECT_EQ(tree.count(key), reference.count(key));
+    }
+}